@@ -0,0 +1,526 @@
+// Microbenchmarks for the allocator, dyn_arr and logger hot paths.
+//
+//     make -C bench run
+//     make -C bench baseline             # writes bench/baseline.txt
+//     make -C bench check TOLERANCE=10   # fails if any median regresses by >10%
+//
+// Every benchmark runs a fixed number of operations per sample and reports
+// percentiles of ns/op over the samples. On Linux, cycles and instructions
+// per op are read from perf events when the kernel allows it.
+
+#define _DEFAULT_SOURCE
+#define CORE_IMPLEMENTATION
+#include "../core.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_SAMPLES 31
+#define BENCH_WARMUP_SAMPLES 3
+#define BENCH_MAX_COUNT 64
+
+// =============================================================================
+// HARNESS
+// =============================================================================
+
+typedef struct bench_t bench_t;
+struct bench_t {
+    const char* name;
+    size_t ops;
+    void (*setup)(void);
+    void (*run)(size_t ops);
+    void (*teardown)(void);
+};
+
+typedef struct bench_result_t bench_result_t;
+struct bench_result_t {
+    const char* name;
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double cycles;
+    double instructions;
+};
+
+#if defined(__GNUC__)
+#define bench_keep(ptr) __asm__ volatile("" : : "g"(ptr) : "memory")
+#else
+static void* volatile g_bench_sink;
+#define bench_keep(ptr) (g_bench_sink = (void*) (ptr))
+#endif
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+#if defined(__linux__)
+static int g_perf_fd = -1;
+
+static int _perf_open(uint64_t config, int group) {
+    struct perf_event_attr attr = {0};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void bench_counters_open(void) {
+    g_perf_fd = _perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (g_perf_fd >= 0 && _perf_open(PERF_COUNT_HW_INSTRUCTIONS, g_perf_fd) < 0) {
+        close(g_perf_fd);
+        g_perf_fd = -1;
+    }
+}
+
+static void bench_counters_start(void) {
+    if (g_perf_fd >= 0) {
+        ioctl(g_perf_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(g_perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+// Returns false when counters are unavailable.
+static bool bench_counters_stop(uint64_t* cycles, uint64_t* instructions) {
+    if (g_perf_fd < 0) {
+        return false;
+    }
+    ioctl(g_perf_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t values[3];
+    if (read(g_perf_fd, values, sizeof(values)) != sizeof(values)) {
+        return false;
+    }
+    *cycles = values[1];
+    *instructions = values[2];
+    return true;
+}
+#else
+static void bench_counters_open(void) {}
+static void bench_counters_start(void) {}
+static bool bench_counters_stop(uint64_t* cycles, uint64_t* instructions) {
+    unused(cycles);
+    unused(instructions);
+    return false;
+}
+#endif
+
+static int _compare_double(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static double _percentile(const double* sorted, size_t count, double percentile) {
+    size_t index = (size_t) (percentile * (double) (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static bench_result_t bench_run(const bench_t* bench) {
+    double samples[BENCH_SAMPLES];
+    double cycles[BENCH_SAMPLES];
+    double instructions[BENCH_SAMPLES];
+    bool counted = true;
+    for (int32_t i = -BENCH_WARMUP_SAMPLES; i < BENCH_SAMPLES; i++) {
+        if (bench->setup != NULL) {
+            bench->setup();
+        }
+        uint64_t cycle_count = 0;
+        uint64_t instruction_count = 0;
+        bench_counters_start();
+        uint64_t start = bench_now_ns();
+        bench->run(bench->ops);
+        uint64_t elapsed = bench_now_ns() - start;
+        bool has_counters = bench_counters_stop(&cycle_count, &instruction_count);
+        if (bench->teardown != NULL) {
+            bench->teardown();
+        }
+        if (i < 0) {
+            continue;
+        }
+        samples[i] = (double) elapsed / (double) bench->ops;
+        cycles[i] = (double) cycle_count / (double) bench->ops;
+        instructions[i] = (double) instruction_count / (double) bench->ops;
+        counted = counted && has_counters;
+    }
+    qsort(samples, BENCH_SAMPLES, sizeof(double), _compare_double);
+    qsort(cycles, BENCH_SAMPLES, sizeof(double), _compare_double);
+    qsort(instructions, BENCH_SAMPLES, sizeof(double), _compare_double);
+    return (bench_result_t) {
+        .name = bench->name,
+        .min = samples[0],
+        .p50 = _percentile(samples, BENCH_SAMPLES, 0.5),
+        .p90 = _percentile(samples, BENCH_SAMPLES, 0.9),
+        .p99 = _percentile(samples, BENCH_SAMPLES, 0.99),
+        .cycles = counted ? _percentile(cycles, BENCH_SAMPLES, 0.5) : -1.0,
+        .instructions = counted ? _percentile(instructions, BENCH_SAMPLES, 0.5) : -1.0,
+    };
+}
+
+// =============================================================================
+// ALLOCATORS
+// =============================================================================
+
+static void* _malloc_alloc(size_t size, void* context) {
+    unused(context);
+    return malloc(size);
+}
+
+static void* _malloc_realloc(void* ptr, size_t old_size, size_t new_size, void* context) {
+    unused(old_size);
+    unused(context);
+    return realloc(ptr, new_size);
+}
+
+static void _malloc_free(void* ptr, size_t size, void* context) {
+    unused(size);
+    unused(context);
+    free(ptr);
+}
+
+static const allocator_t g_malloc_allocator = {
+    .alloc = _malloc_alloc,
+    .realloc = _malloc_realloc,
+    .free = _malloc_free,
+    .context = NULL,
+};
+
+#define ALLOC_OPS 100000
+
+static arena_t* g_arena = NULL;
+static pool_t* g_pool = NULL;
+static heap_t* g_heap = NULL;
+static void* g_pointers[ALLOC_OPS];
+
+static void arena_setup(void) {
+    g_arena = arena_create_reserve((size_t) 1 << 30, 0);
+}
+
+static void arena_teardown(void) {
+    arena_destroy(&g_arena);
+}
+
+static void bench_arena_push_16(size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        bench_keep(arena_push(g_arena, 16));
+    }
+}
+
+static void bench_arena_push_aligned_64(size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        bench_keep(arena_push_aligned(g_arena, 24, 64));
+    }
+}
+
+static void bench_malloc_16(size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        g_pointers[i] = malloc(16);
+        bench_keep(g_pointers[i]);
+    }
+}
+
+static void malloc_teardown(void) {
+    for (size_t i = 0; i < ALLOC_OPS; i++) {
+        free(g_pointers[i]);
+    }
+}
+
+static void bench_malloc_free_16(size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        void* ptr = malloc(16);
+        bench_keep(ptr);
+        free(ptr);
+    }
+}
+
+static void pool_setup(void) {
+    g_pool = pool_create(g_malloc_allocator, 16, 0);
+}
+
+static void pool_teardown(void) {
+    pool_destroy(&g_pool);
+}
+
+static void bench_pool_alloc_free_16(size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        void* ptr = pool_alloc(g_pool);
+        bench_keep(ptr);
+        pool_free(g_pool, ptr);
+    }
+}
+
+static void heap_setup(void) {
+    g_heap = heap_create(g_malloc_allocator);
+}
+
+static void heap_teardown(void) {
+    heap_destroy(&g_heap);
+}
+
+static void bench_heap_alloc_free_48(size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        void* ptr = heap_alloc(g_heap, 48);
+        bench_keep(ptr);
+        heap_free(g_heap, ptr, 48);
+    }
+}
+
+// =============================================================================
+// DYNAMIC ARRAY
+// =============================================================================
+
+#define PUSH_OPS 100000
+#define EDIT_OPS 1000
+#define EDIT_LENGTH 1000
+
+static void* g_dyn_arr = NULL;
+static uint8_t g_element[64];
+
+static void dyn_arr_malloc_setup(void) {
+    g_dyn_arr = NULL;
+}
+
+static void dyn_arr_teardown(void) {
+    dyn_arr_destroy(&g_dyn_arr);
+    if (g_arena != NULL) {
+        arena_destroy(&g_arena);
+    }
+}
+
+#define BENCH_DYN_ARR_PUSH(element_size, allocator) \
+    static void bench_dyn_arr_push_##element_size##_##allocator(size_t ops) { \
+        g_dyn_arr = dyn_arr_create(g_arena == NULL ? g_malloc_allocator : arena_allocator(g_arena), element_size); \
+        for (size_t i = 0; i < ops; i++) { \
+            dyn_arr_push(&g_dyn_arr, g_element); \
+        } \
+        bench_keep(g_dyn_arr); \
+    }
+
+BENCH_DYN_ARR_PUSH(4, malloc)
+BENCH_DYN_ARR_PUSH(16, malloc)
+BENCH_DYN_ARR_PUSH(64, malloc)
+BENCH_DYN_ARR_PUSH(4, arena)
+BENCH_DYN_ARR_PUSH(16, arena)
+BENCH_DYN_ARR_PUSH(64, arena)
+
+static void bench_dyn_arr_push_t_int(size_t ops) {
+    dyn_arr_t(int) arr = dyn_arr_create(g_malloc_allocator, sizeof(int));
+    for (size_t i = 0; i < ops; i++) {
+        dyn_arr_push_t(arr, (int) i);
+    }
+    bench_keep(arr);
+    g_dyn_arr = arr;
+}
+
+static void dyn_arr_edit_setup(void) {
+    g_dyn_arr = dyn_arr_create(g_malloc_allocator, sizeof(uint64_t));
+    for (size_t i = 0; i < EDIT_LENGTH; i++) {
+        dyn_arr_push(&g_dyn_arr, &i);
+    }
+}
+
+static void bench_dyn_arr_insert_remove_front(size_t ops) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < ops; i++) {
+        dyn_arr_insert(&g_dyn_arr, 0, &value);
+        dyn_arr_remove(&g_dyn_arr, 0, &value);
+    }
+}
+
+static void bench_dyn_arr_insert_remove_fast(size_t ops) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < ops; i++) {
+        dyn_arr_insert_fast(&g_dyn_arr, 0, &value);
+        dyn_arr_remove_fast(&g_dyn_arr, 0, &value);
+    }
+}
+
+// =============================================================================
+// LOGGER
+// =============================================================================
+
+#define LOG_OPS 100000
+
+static uint64_t g_log_count = 0;
+
+static void _count_callback(log_event_t event, void* userdata) {
+    unused(event);
+    unused(userdata);
+    g_log_count++;
+}
+
+static void log_setup_1(void) {
+    logger_register_callback(_count_callback, &g_log_count);
+}
+
+static void log_setup_4(void) {
+    for (uint32_t i = 0; i < 4; i++) {
+        logger_register_callback(_count_callback, &g_log_count);
+    }
+}
+
+static void log_teardown(void) {
+    logger_unregister(&g_log_count);
+    logger_set_level(LOG_LEVEL_TRACE);
+}
+
+static void log_setup_disabled(void) {
+    log_setup_1();
+    logger_set_level(LOG_LEVEL_INFO);
+}
+
+static void log_setup_async(void) {
+    log_setup_1();
+    logger_async_start(g_malloc_allocator, 1 << 16, LOGGER_OVERFLOW_BLOCK);
+}
+
+static void log_teardown_async(void) {
+    logger_async_stop();
+    log_teardown();
+}
+
+static void bench_log_info(size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        log_info("bench %d %s", (int) i, "message");
+    }
+}
+
+static void bench_log_trace(size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        log_trace("bench %d %s", (int) i, "message");
+    }
+}
+
+// =============================================================================
+// MAIN
+// =============================================================================
+
+static const bench_t g_benches[] = {
+    { "arena_push_16", ALLOC_OPS, arena_setup, bench_arena_push_16, arena_teardown },
+    { "arena_push_aligned_64", ALLOC_OPS, arena_setup, bench_arena_push_aligned_64, arena_teardown },
+    { "malloc_16", ALLOC_OPS, NULL, bench_malloc_16, malloc_teardown },
+    { "malloc_free_16", ALLOC_OPS, NULL, bench_malloc_free_16, NULL },
+    { "pool_alloc_free_16", ALLOC_OPS, pool_setup, bench_pool_alloc_free_16, pool_teardown },
+    { "heap_alloc_free_48", ALLOC_OPS, heap_setup, bench_heap_alloc_free_48, heap_teardown },
+
+    { "dyn_arr_push_4_malloc", PUSH_OPS, dyn_arr_malloc_setup, bench_dyn_arr_push_4_malloc, dyn_arr_teardown },
+    { "dyn_arr_push_16_malloc", PUSH_OPS, dyn_arr_malloc_setup, bench_dyn_arr_push_16_malloc, dyn_arr_teardown },
+    { "dyn_arr_push_64_malloc", PUSH_OPS, dyn_arr_malloc_setup, bench_dyn_arr_push_64_malloc, dyn_arr_teardown },
+    { "dyn_arr_push_4_arena", PUSH_OPS, arena_setup, bench_dyn_arr_push_4_arena, dyn_arr_teardown },
+    { "dyn_arr_push_16_arena", PUSH_OPS, arena_setup, bench_dyn_arr_push_16_arena, dyn_arr_teardown },
+    { "dyn_arr_push_64_arena", PUSH_OPS, arena_setup, bench_dyn_arr_push_64_arena, dyn_arr_teardown },
+    { "dyn_arr_push_t_int", PUSH_OPS, dyn_arr_malloc_setup, bench_dyn_arr_push_t_int, dyn_arr_teardown },
+    { "dyn_arr_insert_remove_front", EDIT_OPS, dyn_arr_edit_setup, bench_dyn_arr_insert_remove_front, dyn_arr_teardown },
+    { "dyn_arr_insert_remove_fast", EDIT_OPS, dyn_arr_edit_setup, bench_dyn_arr_insert_remove_fast, dyn_arr_teardown },
+
+    { "log_info_0_callbacks", LOG_OPS, NULL, bench_log_info, NULL },
+    { "log_info_1_callback", LOG_OPS, log_setup_1, bench_log_info, log_teardown },
+    { "log_info_4_callbacks", LOG_OPS, log_setup_4, bench_log_info, log_teardown },
+    { "log_trace_disabled", LOG_OPS, log_setup_disabled, bench_log_trace, log_teardown },
+    { "log_info_async", LOG_OPS, log_setup_async, bench_log_info, log_teardown_async },
+};
+
+#define BENCH_COUNT (sizeof(g_benches) / sizeof(g_benches[0]))
+
+// Reads "name p50" lines written by --save.
+static size_t _load_baseline(const char* path, char names[][64], double* values) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open baseline %s\n", path);
+        exit(2);
+    }
+    size_t count = 0;
+    while (count < BENCH_MAX_COUNT && fscanf(file, "%63s %lf", names[count], &values[count]) == 2) {
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+int main(int argc, char** argv) {
+    const char* filter = NULL;
+    const char* save_path = NULL;
+    const char* compare_path = NULL;
+    double tolerance = 10.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--filter substring] [--save file] [--compare file] [--tolerance percent]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bench_counters_open();
+    memset(g_element, 0xAB, sizeof(g_element));
+
+    bench_result_t results[BENCH_COUNT];
+    size_t result_count = 0;
+    printf("%-30s %10s %10s %10s %10s %10s %10s\n", "benchmark", "min", "p50", "p90", "p99", "cycles", "instr");
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        if (filter != NULL && strstr(g_benches[i].name, filter) == NULL) {
+            continue;
+        }
+        bench_result_t result = bench_run(&g_benches[i]);
+        results[result_count++] = result;
+        printf("%-30s %10.2f %10.2f %10.2f %10.2f", result.name, result.min, result.p50, result.p90, result.p99);
+        if (result.cycles >= 0.0) {
+            printf(" %10.1f %10.1f\n", result.cycles, result.instructions);
+        } else {
+            printf(" %10s %10s\n", "-", "-");
+        }
+        fflush(stdout);
+    }
+    printf("(ns/op; cycles and instructions are medians per op)\n");
+
+    if (save_path != NULL) {
+        FILE* file = fopen(save_path, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Failed to write baseline %s\n", save_path);
+            return 2;
+        }
+        for (size_t i = 0; i < result_count; i++) {
+            fprintf(file, "%s %.4f\n", results[i].name, results[i].p50);
+        }
+        fclose(file);
+    }
+
+    int status = 0;
+    if (compare_path != NULL) {
+        char names[BENCH_MAX_COUNT][64];
+        double values[BENCH_MAX_COUNT];
+        size_t count = _load_baseline(compare_path, names, values);
+        for (size_t i = 0; i < result_count; i++) {
+            for (size_t j = 0; j < count; j++) {
+                if (strcmp(results[i].name, names[j]) != 0 || values[j] <= 0.0) {
+                    continue;
+                }
+                double change = (results[i].p50 / values[j] - 1.0) * 100.0;
+                bool regressed = change > tolerance;
+                printf("%-30s %10.2f -> %10.2f %+7.1f%%%s\n", results[i].name, values[j], results[i].p50, change, regressed ? "  REGRESSION" : "");
+                if (regressed) {
+                    status = 1;
+                }
+            }
+        }
+    }
+    return status;
+}
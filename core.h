@@ -1,10 +1,15 @@
 #ifndef CORE_H
 #define CORE_H
 
+#if defined(CORE_IMPLEMENTATION) && !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stddef.h>
 #include <stdint.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 // =============================================================================
 // ALLOCATOR INTERFACE
@@ -26,6 +31,12 @@ struct allocator_t {
 #define core_realloc(allocator, ptr, old_size, new_size) (allocator).realloc((ptr), (old_size), (new_size), (allocator).context)
 #define core_free(allocator, ptr, size) (allocator).free((ptr), (size), (allocator).context)
 
+// Maps whole pages straight from the OS, rounding every size up to the page
+// size. Meant as a parent for arenas and pools, not for small allocations.
+extern allocator_t os_allocator(void);
+
+typedef struct arena_t arena_t;
+
 // =============================================================================
 // LOGGING
 // =============================================================================
@@ -48,20 +59,262 @@ struct log_event_t {
     int32_t line;
     const char* message;
     va_list args;
+    // Nanoseconds since the Unix epoch.
+    uint64_t timestamp;
+    uint64_t thread_id;
 };
 
 typedef void (*logger_callback_func_t)(log_event_t event, void* userdata);
+typedef void (*logger_flush_func_t)(void* userdata);
+
+#define LOG_LEVEL_BIT(level) (1u << (level))
+// Every level at least as severe as 'level'.
+#define LOG_LEVEL_MASK(level) ((LOG_LEVEL_BIT(level) << 1) - 1)
+#define LOG_LEVEL_MASK_ALL LOG_LEVEL_MASK(LOG_LEVEL_TRACE)
 
 extern void logger_register_callback(logger_callback_func_t func, void* userdata);
+// The callback only receives events whose level bit is set in 'level_mask'.
+extern void logger_register_callback_mask(logger_callback_func_t func, void* userdata, uint32_t level_mask);
+// Flush callbacks run on logger_flush and, when logging asynchronously,
+// whenever the background thread runs out of events.
+extern void logger_register_flush_callback(logger_flush_func_t func, void* userdata);
+// Removes every callback and flush callback registered with 'userdata'.
+extern void logger_unregister(void* userdata);
+// Events less severe than 'level' are discarded before their arguments are evaluated.
+extern void logger_set_level(log_level_t level);
+extern log_level_t logger_get_level(void);
+
+// Asynchronous logging. Events are captured into a lock-free ring buffer of
+// 'capacity' records on the logging thread and dispatched to the callbacks by
+// a background thread. The log_* macros capture their raw arguments so that
+// formatting happens on the background thread; messages which can't be
+// captured are formatted up front. Fatal events are flushed before returning.
+// Start and stop must not race with logging from other threads. Callbacks
+// may be registered and removed while the background thread is dispatching,
+// but not while other threads log synchronously.
+#ifndef CORE_LOG_ASYNC_MESSAGE_SIZE
+#define CORE_LOG_ASYNC_MESSAGE_SIZE 256
+#endif
+
+typedef enum logger_overflow_policy_t {
+    // Discard the event when the ring buffer is full.
+    LOGGER_OVERFLOW_DROP,
+    // Wait for the background thread to make room.
+    LOGGER_OVERFLOW_BLOCK,
+} logger_overflow_policy_t;
+
+extern bool logger_async_start(allocator_t allocator, size_t capacity, logger_overflow_policy_t policy);
+extern void logger_async_stop(void);
+// Blocks until every event logged before the call has been dispatched and
+// the flush callbacks have run.
+extern void logger_flush(void);
+extern uint64_t logger_dropped_count(void);
+
+// Binary logging. While a binary log is open every event is also appended to
+// it as a call site id plus the raw argument bytes; each call site's format
+// string, file and line are written once. Files use the native byte order and
+// are turned back into text events by log_binary_decode.
+#ifndef CORE_LOG_MAX_ARGS
+#define CORE_LOG_MAX_ARGS 16
+#endif
+
+// Static per call site descriptor created by the log_* macros and registered
+// the first time the statement fires.
+typedef struct log_site_t log_site_t;
+struct log_site_t {
+    log_level_t level;
+    const char* file;
+    int32_t line;
+    // NULL unless the format is a string literal.
+    const char* message;
+    _Atomic uint32_t id;
+    bool deferrable;
+    uint8_t arg_count;
+    uint8_t arg_types[CORE_LOG_MAX_ARGS];
+    log_site_t* next;
+};
+
+extern bool logger_binary_open(const char* path);
+extern void logger_binary_close(void);
+// Decodes a binary log and hands every event to 'func' as a "%s" message.
+extern bool log_binary_decode(allocator_t allocator, const char* path, logger_callback_func_t func, void* userdata);
+
+// Stock sinks. Events are formatted as
+// "2026-01-31T12:00:00.000Z INFO  file.c:42: message" straight into a buffer
+// allocated once from the sink's arena and written out in batches: when the
+// buffer fills, an event at least as severe as 'flush_level' arrives or the
+// logger is flushed. 'flush_interval_ms' is only checked as events arrive, so
+// output buffered before logging goes quiet waits for the next event, a
+// logger_flush or, when logging asynchronously, the background thread
+// running out of events. Console sinks write to stderr and also flush after
+// every event unless logging asynchronously.
+// File sinks rotate 'path' to 'path.1' ... 'path.<max_files>' once it grows
+// past 'max_file_size'. Zeroed fields take their defaults.
+#define LOG_SINK_DEFAULT_BUFFER_SIZE (64 * 1024)
+#define LOG_SINK_DEFAULT_FLUSH_INTERVAL_MS 1000
+
+typedef struct log_sink_desc_t log_sink_desc_t;
+struct log_sink_desc_t {
+    size_t buffer_size;
+    uint32_t flush_interval_ms;
+    log_level_t flush_level;
+    size_t max_file_size;
+    uint32_t max_files;
+    // ANSI colour escapes around the level name.
+    bool colour;
+};
+
+typedef struct log_sink_t log_sink_t;
+struct log_sink_t {
+    arena_t* arena;
+    void* file;
+    const char* path;
+    log_sink_desc_t desc;
+    bool console;
+    atomic_flag lock;
+    char* buffer;
+    size_t length;
+    size_t file_size;
+    uint64_t last_flush;
+};
+
+extern log_sink_t* log_sink_create_file(allocator_t allocator, const char* path, const log_sink_desc_t* desc);
+extern log_sink_t* log_sink_create_console(allocator_t allocator, const log_sink_desc_t* desc);
+// Flushes, unregisters and frees the sink.
+extern void log_sink_destroy(log_sink_t** sink);
+// Registers the sink's event and flush callbacks with the logger.
+extern void log_sink_register(log_sink_t* sink, uint32_t level_mask);
+extern void log_sink_callback(log_event_t event, void* userdata);
+extern void log_sink_flush(void* userdata);
+
+// Numeric log_level_t value of the least severe level compiled in, from 0
+// (fatal only) to 5 (everything). Fatal events are always compiled in.
+#ifndef CORE_LOG_MIN_LEVEL
+#define CORE_LOG_MIN_LEVEL 5
+#endif
+
+// Union of the runtime level and every callback's level mask.
+extern _Atomic uint32_t _log_level_mask;
+
+#define _log_enabled(event_level) (atomic_load_explicit(&_log_level_mask, memory_order_relaxed) & LOG_LEVEL_BIT(event_level))
+
+// A site only remembers its format when it is a string literal, the one case
+// where the text can't change between calls. Other formats are always
+// formatted eagerly.
+#define _log_first(...) _log_first_(__VA_ARGS__, 0)
+#define _log_first_(first, ...) first
+#if defined(__GNUC__)
+#define _log_literal(message) (__builtin_constant_p(message) ? (message) : (const char*) 0)
+#else
+#define _log_literal(message) ((const char*) 0)
+#endif
+
+#define _log_gated(event_level, ...) do { \
+        if (_log_enabled(event_level)) { \
+            static log_site_t _log_site = { .level = (event_level), .file = __FILE__, .line = __LINE__, .message = _log_literal(_log_first(__VA_ARGS__)) }; \
+            _log_log_site(&_log_site, __VA_ARGS__); \
+        } \
+    } while (0)
+// Still type checks the arguments but never evaluates them.
+#define _log_disabled(event_level, ...) do { \
+        if (0) { \
+            _log_log((event_level), __FILE__, __LINE__, __VA_ARGS__); \
+        } \
+    } while (0)
+
+// Rate limited logging. Every statement keeps its own counters, and once it
+// fires again after having been suppressed it reports how many events were
+// dropped in between.
+typedef struct _log_limit_t _log_limit_t;
+struct _log_limit_t {
+    _Atomic uint64_t count;
+    _Atomic uint64_t suppressed;
+    _Atomic uint64_t window_start;
+    _Atomic uint32_t window_count;
+};
+
+extern bool _log_limit_every_n(_log_limit_t* limit, uint64_t n, uint64_t* suppressed);
+extern bool _log_limit_once(_log_limit_t* limit);
+extern bool _log_limit_rate(_log_limit_t* limit, uint32_t max_per_second, uint64_t* suppressed);
+
+#define _log_limited(event_level, check, ...) do { \
+        if (_log_enabled(event_level)) { \
+            static _log_limit_t _log_limit = {0}; \
+            uint64_t _log_suppressed = 0; \
+            if (check) { \
+                _log_gated(event_level, __VA_ARGS__); \
+                if (_log_suppressed > 0) { \
+                    _log_gated(event_level, "Suppressed %llu similar messages", (unsigned long long) _log_suppressed); \
+                } \
+            } \
+        } \
+    } while (0)
+
+#define log_fatal(...) _log_gated(LOG_LEVEL_FATAL, __VA_ARGS__)
+#define _log_fatal_limited(check, ...) _log_limited(LOG_LEVEL_FATAL, check, __VA_ARGS__)
+#if CORE_LOG_MIN_LEVEL >= 1
+#define log_error(...) _log_gated(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define _log_error_limited(check, ...) _log_limited(LOG_LEVEL_ERROR, check, __VA_ARGS__)
+#else
+#define log_error(...) _log_disabled(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define _log_error_limited(check, ...) _log_disabled(LOG_LEVEL_ERROR, __VA_ARGS__)
+#endif
+#if CORE_LOG_MIN_LEVEL >= 2
+#define log_warn(...) _log_gated(LOG_LEVEL_WARN, __VA_ARGS__)
+#define _log_warn_limited(check, ...) _log_limited(LOG_LEVEL_WARN, check, __VA_ARGS__)
+#else
+#define log_warn(...) _log_disabled(LOG_LEVEL_WARN, __VA_ARGS__)
+#define _log_warn_limited(check, ...) _log_disabled(LOG_LEVEL_WARN, __VA_ARGS__)
+#endif
+#if CORE_LOG_MIN_LEVEL >= 3
+#define log_info(...) _log_gated(LOG_LEVEL_INFO, __VA_ARGS__)
+#define _log_info_limited(check, ...) _log_limited(LOG_LEVEL_INFO, check, __VA_ARGS__)
+#else
+#define log_info(...) _log_disabled(LOG_LEVEL_INFO, __VA_ARGS__)
+#define _log_info_limited(check, ...) _log_disabled(LOG_LEVEL_INFO, __VA_ARGS__)
+#endif
+#if CORE_LOG_MIN_LEVEL >= 4
+#define log_debug(...) _log_gated(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define _log_debug_limited(check, ...) _log_limited(LOG_LEVEL_DEBUG, check, __VA_ARGS__)
+#else
+#define log_debug(...) _log_disabled(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define _log_debug_limited(check, ...) _log_disabled(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
+#if CORE_LOG_MIN_LEVEL >= 5
+#define log_trace(...) _log_gated(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define _log_trace_limited(check, ...) _log_limited(LOG_LEVEL_TRACE, check, __VA_ARGS__)
+#else
+#define log_trace(...) _log_disabled(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define _log_trace_limited(check, ...) _log_disabled(LOG_LEVEL_TRACE, __VA_ARGS__)
+#endif
+
+// Logs the first event and then every n-th one.
+#define log_fatal_every_n(n, ...) _log_fatal_limited(_log_limit_every_n(&_log_limit, (n), &_log_suppressed), __VA_ARGS__)
+#define log_error_every_n(n, ...) _log_error_limited(_log_limit_every_n(&_log_limit, (n), &_log_suppressed), __VA_ARGS__)
+#define log_warn_every_n(n, ...) _log_warn_limited(_log_limit_every_n(&_log_limit, (n), &_log_suppressed), __VA_ARGS__)
+#define log_info_every_n(n, ...) _log_info_limited(_log_limit_every_n(&_log_limit, (n), &_log_suppressed), __VA_ARGS__)
+#define log_debug_every_n(n, ...) _log_debug_limited(_log_limit_every_n(&_log_limit, (n), &_log_suppressed), __VA_ARGS__)
+#define log_trace_every_n(n, ...) _log_trace_limited(_log_limit_every_n(&_log_limit, (n), &_log_suppressed), __VA_ARGS__)
 
-#define log_fatal(...) _log_log(LOG_LEVEL_FATAL, __FILE__, __LINE__, __VA_ARGS__)
-#define log_error(...) _log_log(LOG_LEVEL_ERROR, __FILE__, __LINE__, __VA_ARGS__)
-#define log_warn(...) _log_log(LOG_LEVEL_WARN, __FILE__, __LINE__, __VA_ARGS__)
-#define log_info(...) _log_log(LOG_LEVEL_INFO, __FILE__, __LINE__, __VA_ARGS__)
-#define log_debug(...) _log_log(LOG_LEVEL_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
-#define log_trace(...) _log_log(LOG_LEVEL_TRACE, __FILE__, __LINE__, __VA_ARGS__)
+#define log_fatal_once(...) _log_fatal_limited(_log_limit_once(&_log_limit), __VA_ARGS__)
+#define log_error_once(...) _log_error_limited(_log_limit_once(&_log_limit), __VA_ARGS__)
+#define log_warn_once(...) _log_warn_limited(_log_limit_once(&_log_limit), __VA_ARGS__)
+#define log_info_once(...) _log_info_limited(_log_limit_once(&_log_limit), __VA_ARGS__)
+#define log_debug_once(...) _log_debug_limited(_log_limit_once(&_log_limit), __VA_ARGS__)
+#define log_trace_once(...) _log_trace_limited(_log_limit_once(&_log_limit), __VA_ARGS__)
+
+// Logs at most 'max_per_second' events in every one second window. Events
+// within the budget cost a relaxed atomic; once it is spent every suppressed
+// event also reads the monotonic clock to notice the window ending.
+#define log_fatal_rate_limited(max_per_second, ...) _log_fatal_limited(_log_limit_rate(&_log_limit, (max_per_second), &_log_suppressed), __VA_ARGS__)
+#define log_error_rate_limited(max_per_second, ...) _log_error_limited(_log_limit_rate(&_log_limit, (max_per_second), &_log_suppressed), __VA_ARGS__)
+#define log_warn_rate_limited(max_per_second, ...) _log_warn_limited(_log_limit_rate(&_log_limit, (max_per_second), &_log_suppressed), __VA_ARGS__)
+#define log_info_rate_limited(max_per_second, ...) _log_info_limited(_log_limit_rate(&_log_limit, (max_per_second), &_log_suppressed), __VA_ARGS__)
+#define log_debug_rate_limited(max_per_second, ...) _log_debug_limited(_log_limit_rate(&_log_limit, (max_per_second), &_log_suppressed), __VA_ARGS__)
+#define log_trace_rate_limited(max_per_second, ...) _log_trace_limited(_log_limit_rate(&_log_limit, (max_per_second), &_log_suppressed), __VA_ARGS__)
 
 extern void _log_log(log_level_t level, const char* file, int32_t line, const char* message, ...);
+extern void _log_log_site(log_site_t* site, const char* message, ...);
 
 // =============================================================================
 // UTILITY
@@ -69,6 +322,12 @@ extern void _log_log(log_level_t level, const char* file, int32_t line, const ch
 
 #define unused(var) (void) var
 
+#if defined(_MSC_VER)
+#define core_thread_local __declspec(thread)
+#else
+#define core_thread_local _Thread_local
+#endif
+
 #if defined(__GNUC__)
 #define debug_break() __builtin_trap()
 #elif defined(_MSC_VER)
@@ -96,27 +355,141 @@ extern void _log_log(log_level_t level, const char* file, int32_t line, const ch
 // ARENA ALLOCATOR
 // =============================================================================
 
-typedef struct arena_t arena_t;
+#define ARENA_DEFAULT_COMMIT_GRANULARITY (64 * 1024)
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+typedef enum arena_flags_t {
+    ARENA_FLAG_NONE = 0,
+    // Memory is a reserved virtual address range committed on demand.
+    ARENA_FLAG_VIRTUAL = 1 << 0,
+    // New blocks are linked from the parent allocator once the current one is exhausted.
+    ARENA_FLAG_CHAINED = 1 << 1,
+    // The first block is owned by the caller and is never freed.
+    ARENA_FLAG_EXTERNAL = 1 << 2,
+    // Memory is a file mapping made by arena_map.
+    ARENA_FLAG_MAPPED = 1 << 3,
+    // Newly committed pages are faulted in straight away by the committing thread.
+    ARENA_FLAG_PREFAULT = 1 << 4,
+    // Rewinds decommit pages according to arena_set_decommit_policy.
+    ARENA_FLAG_DECOMMIT = 1 << 5,
+    // Mapped read-only, so nothing can be pushed and rewinds are ignored.
+    ARENA_FLAG_READ_ONLY = 1 << 6,
+    // Memory is explicit huge pages, committed as a whole and never decommitted.
+    ARENA_FLAG_HUGE_EXPLICIT = 1 << 7,
+} arena_flags_t;
+
+typedef enum arena_pages_t {
+    ARENA_PAGES_DEFAULT,
+    // Aligns the reservation to huge pages and asks for transparent huge pages.
+    ARENA_PAGES_HUGE_TRANSPARENT,
+    // Maps the whole reservation from the explicit huge page pool (MAP_HUGETLB,
+    // MEM_LARGE_PAGES), falling back to transparent huge pages if none are available.
+    ARENA_PAGES_HUGE_EXPLICIT,
+} arena_pages_t;
+
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Options for reserve arenas, see arena_create_reserve. NUMA binding uses
+// mbind on Linux and VirtualAllocExNuma on Windows, and is ignored where
+// unsupported. arena_create_desc returns NULL when a requested bind fails,
+// huge page mappings included. Prefaulting on the thread that will use the arena also gets
+// first touch placement without explicit binding.
+typedef struct arena_desc_t arena_desc_t;
+struct arena_desc_t {
+    size_t reserve_size;
+    size_t commit_granularity;
+    arena_pages_t pages;
+    bool bind_numa_node;
+    uint32_t numa_node;
+    bool prefault;
+};
+
+typedef struct _arena_block_t _arena_block_t;
+
+// Define CORE_ARENA_STATS in every translation unit to keep usage statistics
+// on each arena and a registry of live arenas. Byte counts include headers.
+#if defined(CORE_ARENA_STATS)
+typedef struct arena_stats_t arena_stats_t;
+struct arena_stats_t {
+    // Bytes in use across all blocks and the most ever in use, across resets.
+    size_t used_bytes;
+    size_t high_water_mark;
+    // Bytes skipped to satisfy alignment.
+    size_t padding_bytes;
+    uint64_t push_count;
+    uint64_t failed_push_count;
+    uint64_t reset_count;
+    uint64_t scope_rewind_count;
+    uint32_t scope_depth;
+    uint32_t max_scope_depth;
+    // Bytes held by blocks before the current one.
+    size_t _block_base;
+};
+#endif
+
+// 'memory', 'capacity', 'position' and 'last_position' always describe the
+// block currently being allocated from. For chained arenas the first block is
+// the arena itself and 'block' points at the newest linked block.
 struct arena_t {
     allocator_t allocator;
     uint8_t* memory;
     size_t capacity;
     size_t position;
     size_t last_position;
+    size_t committed;
+    size_t commit_granularity;
+    size_t block_size;
+    _arena_block_t* block;
+    _arena_block_t* free_blocks;
+    size_t decommit_retain;
+    size_t decommit_hysteresis;
+    size_t rewind_peak;
+    uint32_t flags;
+#if defined(CORE_ARENA_STATS)
+    const char* name;
+    arena_stats_t stats;
+    arena_t* _registry_prev;
+    arena_t* _registry_next;
+#endif
 };
 
 extern arena_t* arena_create(allocator_t allocator, size_t capacity);
 extern arena_t* arena_create_from_buffer(uint8_t* buffer, size_t capacity);
+// Reserves 'reserve_size' bytes of address space and commits it in chunks of
+// 'commit_granularity' bytes as the arena grows. The arena never moves.
+// Returns NULL if the reservation fails.
+extern arena_t* arena_create_reserve(size_t reserve_size, size_t commit_granularity);
+extern arena_t* arena_create_desc(const arena_desc_t* desc);
+// Chained arenas link a new block of at least 'block_size' bytes from
+// 'allocator' whenever the current block is exhausted. Blocks released by
+// arena_reset and arena_scope_end are cached for reuse until arena_trim.
+extern arena_t* arena_create_chained(allocator_t allocator, size_t block_size);
+extern arena_t* arena_create_chained_from_buffer(uint8_t* buffer, size_t capacity, allocator_t allocator, size_t block_size);
 extern void arena_destroy(arena_t** arena);
 extern allocator_t arena_allocator(arena_t* arena);
 
 extern void* arena_push(arena_t* arena, size_t size);
 extern void* arena_push_aligned(arena_t* arena, size_t size, size_t align);
+// Releases the last 'size' bytes of the current block.
+extern void arena_pop(arena_t* arena, size_t size);
+// Grows or shrinks 'ptr' without moving it. Only succeeds for the most recent
+// allocation and only if the arena has room for the new size.
+extern bool arena_resize_in_place(arena_t* arena, void* ptr, size_t new_size);
 extern void arena_reset(arena_t* arena);
+// Lets arena_reset and arena_scope_end of a reserve arena give memory back to
+// the OS. A rewind decommits down to the larger of 'retain_size' and the peak
+// position seen at the last two rewinds, but only once that frees at least
+// 'hysteresis' bytes. Loops with a steady peak therefore never thrash, while
+// a burst is released after two calmer rewinds. Ignored for mapped arenas and
+// for arenas backed by explicit huge pages, which can't be decommitted safely.
+extern void arena_set_decommit_policy(arena_t* arena, size_t retain_size, size_t hysteresis);
+// Frees cached blocks of a chained arena back to its allocator.
+extern void arena_trim(arena_t* arena);
 
 typedef struct arena_scope_t arena_scope_t;
 struct arena_scope_t {
     arena_t* arena;
+    uint8_t* memory;
     size_t position;
     size_t last_position;
 };
@@ -124,197 +497,249 @@ struct arena_scope_t {
 extern arena_scope_t arena_scope_begin(arena_t* arena);
 extern void arena_scope_end(arena_scope_t* scope);
 
-// =============================================================================
-// DYNAMIC ARRAY
-// =============================================================================
+// Snapshots persist the used part of a single block arena, header included,
+// and map it back copy-on-write so startup is page faults instead of a
+// rebuild. The header is patched on load, so pointers to the arena itself
+// are fine, but data inside must link up through offsets or rel_ptr_t to stay
+// valid at a different base address. Writable maps can keep pushing up to
+// 'reserve_size' bytes, except on Windows where they end with the file.
+// Read-only maps keep their header outside the mapping so every page of the
+// file stays read-only; they refuse pushes and ignore pops, resets and frees.
+extern bool arena_save(const arena_t* arena, const char* path);
+// Returns NULL if the file can't be mapped or isn't an arena snapshot written
+// by a build with the same arena_t layout.
+extern arena_t* arena_map(const char* path, size_t reserve_size, bool writable);
 
-#define dyn_arr_t(T) T*
+// Offsets from the start of a single block arena, stable across snapshots.
+extern size_t arena_offset_of(const arena_t* arena, const void* ptr);
+extern void* arena_ptr_at(const arena_t* arena, size_t offset);
 
-extern void* dyn_arr_create(allocator_t allocator, size_t element_size);
-extern void dyn_arr_destroy(void** dyn_arr);
-extern size_t dyn_arr_length(const void* dyn_arr);
-extern void dyn_arr_clear(void** dyn_arr);
+// Pointer stored as the distance from its own address. 0 is NULL, so a
+// rel_ptr_t can't point at itself.
+typedef int64_t rel_ptr_t;
 
-extern void dyn_arr_insert_arr(void** dyn_arr, size_t index, const void* arr, size_t arr_length);
-extern void dyn_arr_remove_arr(void** dyn_arr, size_t index, size_t count, void* output);
+static inline void rel_ptr_set(rel_ptr_t* rel, const void* ptr) {
+    *rel = ptr == NULL ? 0 : (int64_t) ((uintptr_t) ptr - (uintptr_t) rel);
+}
 
-extern void dyn_arr_insert(void** dyn_arr, size_t index, const void* value);
-extern void dyn_arr_remove(void** dyn_arr, size_t index, void* output);
+static inline void* _rel_ptr_get(const rel_ptr_t* rel) {
+    return *rel == 0 ? NULL : (uint8_t*) rel + *rel;
+}
 
-extern void dyn_arr_insert_fast(void** dyn_arr, size_t index, const void* value);
-extern void dyn_arr_remove_fast(void** dyn_arr, size_t index, void* output);
+#define rel_ptr_get(T, rel) ((T*) _rel_ptr_get(rel))
 
-extern void dyn_arr_push(void** dyn_arr, const void* value);
-extern void dyn_arr_pop(void** dyn_arr, void* output);
+#if defined(CORE_ARENA_STATS)
+typedef void (*arena_visit_func_t)(arena_t* arena, void* userdata);
 
-extern void dyn_arr_push_arr(void** dyn_arr, const void* arr, size_t arr_length);
-extern void dyn_arr_pop_arr(void** dyn_arr, size_t count, void* output);
+// Labels the arena in the registry. 'name' must outlive the arena.
+extern void arena_set_name(arena_t* arena, const char* name);
+extern arena_stats_t arena_stats(const arena_t* arena);
+// Calls 'func' for every live arena while holding the registry lock, so
+// 'func' must not create or destroy arenas.
+extern void arena_registry_visit(arena_visit_func_t func, void* userdata);
+#endif
 
-#ifdef CORE_IMPLEMENTATION
+#ifndef CORE_SCRATCH_ARENA_COUNT
+#define CORE_SCRATCH_ARENA_COUNT 2
+#endif
 
-// TODO: Remove this CRT dependency
-#include <string.h>
+#ifndef CORE_SCRATCH_ARENA_RESERVE
+#define CORE_SCRATCH_ARENA_RESERVE ((size_t) 256 * 1024 * 1024)
+#endif
+
+// Begins a scope on one of the calling thread's scratch arenas, picking one
+// that isn't any of the 'conflicts'. Pass the arenas the caller allocates its
+// results from so temporaries never clobber them.
+extern arena_scope_t scratch_begin(arena_t* const* conflicts, size_t count);
+extern void scratch_end(arena_scope_t* scope);
+// Destroys the calling thread's scratch arenas. Call before a thread exits.
+extern void scratch_release(void);
 
 // =============================================================================
-// LOGGER
+// CONCURRENT ARENA
 // =============================================================================
 
-#define MAX_LOGGER_CALLBACK_COUNT 16
+// Bump allocator which may be pushed to from any number of threads at once.
+// Pushes are a single atomic fetch-add whenever 'align' is at most
+// CONCURRENT_ARENA_ALIGN and a compare-and-swap loop otherwise. Creation,
+// reset and destruction are not thread safe.
+#define CONCURRENT_ARENA_ALIGN sizeof(void*)
 
-typedef struct _logger_callback_t _logger_callback_t;
-struct _logger_callback_t {
-    logger_callback_func_t func;
-    void* userdata;
+typedef struct concurrent_arena_t concurrent_arena_t;
+struct concurrent_arena_t {
+    allocator_t allocator;
+    uint8_t* memory;
+    size_t capacity;
+    _Atomic size_t position;
 };
 
-static _logger_callback_t g_logger_callbacks[MAX_LOGGER_CALLBACK_COUNT] = {0};
-static uint32_t g_logger_callback_count = 0;
+extern concurrent_arena_t* concurrent_arena_create(allocator_t allocator, size_t capacity);
+extern concurrent_arena_t* concurrent_arena_create_from_buffer(uint8_t* buffer, size_t capacity);
+extern void concurrent_arena_destroy(concurrent_arena_t** arena);
+extern allocator_t concurrent_arena_allocator(concurrent_arena_t* arena);
 
-void logger_register_callback(logger_callback_func_t func, void* userdata) {
-    core_assert_msg(g_logger_callback_count < MAX_LOGGER_CALLBACK_COUNT, "Maximum amount of logger callbacks of %d has been reached.", MAX_LOGGER_CALLBACK_COUNT);
-    g_logger_callbacks[g_logger_callback_count] = (_logger_callback_t) {
-        .func = func,
-        .userdata = userdata,
-    };
-    g_logger_callback_count++;
-}
+extern void* concurrent_arena_push(concurrent_arena_t* arena, size_t size);
+extern void* concurrent_arena_push_aligned(concurrent_arena_t* arena, size_t size, size_t align);
+extern void concurrent_arena_reset(concurrent_arena_t* arena);
 
-void _log_log(log_level_t level, const char* file, int32_t line, const char* message, ...) {
-    for (uint32_t i = 0; i < g_logger_callback_count; i++) {
-        log_event_t event = {
-            .level = level,
-            .file = file,
-            .line = line,
-            .message = message,
-        };
-        va_start(event.args, message);
-        _logger_callback_t callback = g_logger_callbacks[i];
-        callback.func(event, callback.userdata);
-        va_end(event.args);
-    }
-}
+// =============================================================================
+// POOL ALLOCATOR
+// =============================================================================
+
+// Fixed size allocator with an intrusive free list. Elements are carved from
+// blocks of 'block_count' elements obtained from the parent allocator, which
+// may be an arena. Blocks are only returned to the parent on destruction.
+#define POOL_DEFAULT_BLOCK_COUNT 64
+
+typedef struct _pool_node_t _pool_node_t;
+typedef struct _pool_block_t _pool_block_t;
+
+typedef struct pool_t pool_t;
+struct pool_t {
+    allocator_t allocator;
+    size_t element_size;
+    size_t block_count;
+    _pool_node_t* free_list;
+    _pool_block_t* blocks;
+    uint8_t* cursor;
+    uint8_t* end;
+};
+
+extern pool_t* pool_create(allocator_t allocator, size_t element_size, size_t block_count);
+extern void pool_destroy(pool_t** pool);
+// Allocations through the adapter must not be larger than the element size.
+extern allocator_t pool_allocator(pool_t* pool);
+
+extern void* pool_alloc(pool_t* pool);
+extern void pool_free(pool_t* pool, void* ptr);
 
 // =============================================================================
-// ARENA ALLOCATOR
+// HEAP ALLOCATOR
 // =============================================================================
 
-arena_t* arena_create(allocator_t allocator, size_t capacity) {
-    arena_t* arena = core_alloc(allocator, capacity);
-    *arena = (arena_t) {
-        .allocator = allocator,
-        .memory = (uint8_t*) arena,
-        .capacity = capacity,
-        .position = sizeof(arena_t),
-        .last_position = sizeof(arena_t),
-    };
-    return arena;
-}
+// General purpose allocator with segregated size classes from 16 bytes up to
+// HEAP_MAX_CLASS_SIZE, each served by a pool of HEAP_SLAB_SIZE slabs. Larger
+// allocations go straight to the parent allocator. Relies on the size passed
+// to free and realloc, so no per-allocation header is stored. Not thread safe.
+#define HEAP_MAX_CLASS_SIZE (32 * 1024)
+#define HEAP_SLAB_SIZE (64 * 1024)
+#define HEAP_CLASS_COUNT 40
 
-arena_t* arena_create_from_buffer(uint8_t* buffer, size_t capacity) {
-    arena_t* arena = (arena_t*) buffer;
-    *arena = (arena_t) {
-        .allocator = {0},
-        .memory = buffer,
-        .capacity = capacity,
-        .position = sizeof(arena_t),
-        .last_position = sizeof(arena_t),
-    };
-    return arena;
-}
+typedef struct heap_t heap_t;
+struct heap_t {
+    allocator_t allocator;
+    pool_t classes[HEAP_CLASS_COUNT];
+};
 
-void arena_destroy(arena_t** arena) {
-    core_free((*arena)->allocator, (*arena)->memory, (*arena)->capacity);
-    *arena = NULL;
-}
+extern heap_t* heap_create(allocator_t allocator);
+extern void heap_destroy(heap_t** heap);
+extern allocator_t heap_allocator(heap_t* heap);
 
-void* _arena_alloc(size_t size, void* context) {
-    arena_t* arena = context;
-    return arena_push(arena, size);
-}
+extern void* heap_alloc(heap_t* heap, size_t size);
+extern void* heap_realloc(heap_t* heap, void* ptr, size_t old_size, size_t new_size);
+extern void heap_free(heap_t* heap, void* ptr, size_t size);
 
-void* _arena_realloc(void* ptr, size_t old_size, size_t new_size, void* context) {
-    if (old_size >= new_size) {
-        return ptr;
-    }
-    arena_t* arena = context;
-    // Resize in place if we're reallocing the last allocation.
-    if ((uintptr_t) arena->memory + arena->last_position == (uintptr_t) ptr) {
-        arena->position = arena->last_position;
-    }
-    void* new_ptr = arena_push(arena, new_size);
-    memcpy(new_ptr, ptr, old_size);
-    return new_ptr;
-}
+// =============================================================================
+// TRACKING ALLOCATOR
+// =============================================================================
 
-void _arena_free(void* ptr, size_t size, void* context) {
-    unused(ptr);
-    unused(size);
-    unused(context);
-}
+// Wraps a parent allocator and counts what goes through it. Counters live in
+// cache line sized shards picked per thread and are only merged when a
+// snapshot is taken. Every allocation is prefixed by a small header naming
+// its call site, so frees are attributed without a lookup. Sites are only
+// recorded for allocations made through core_alloc_site/core_realloc_site.
+// Peak bytes are tracked from batched updates and may lag the true peak by
+// TRACKING_PEAK_BATCH_BYTES per thread.
+#define TRACKING_SHARD_COUNT 16
+#define TRACKING_MAX_SITES 1024
+#define TRACKING_HISTOGRAM_BUCKETS 32
+#define TRACKING_PEAK_BATCH_BYTES (64 * 1024)
 
-allocator_t arena_allocator(arena_t* arena) {
-    return (allocator_t) {
-        .alloc = _arena_alloc,
-        .realloc = _arena_realloc,
-        .free = _arena_free,
-        .context = arena,
-    };
-}
+typedef struct _tracking_shard_t _tracking_shard_t;
+struct _tracking_shard_t {
+    _Atomic int64_t pending_bytes;
+    _Atomic uint64_t allocation_count;
+    _Atomic uint64_t free_count;
+    _Atomic uint64_t realloc_count;
+    _Atomic uint64_t allocated_bytes;
+    _Atomic uint64_t histogram[TRACKING_HISTOGRAM_BUCKETS];
+    // Parent allocators don't guarantee cache line alignment, so shards are
+    // padded to a multiple of the line size instead.
+    uint8_t padding[64 - (5 + TRACKING_HISTOGRAM_BUCKETS) * 8 % 64];
+};
 
-static bool _is_power_of_two(uintptr_t value) {
-    return (value & (value - 1)) == 0;
-}
+typedef struct _tracking_site_t _tracking_site_t;
+struct _tracking_site_t {
+    _Atomic(const char*) file;
+    int32_t line;
+    _Atomic int64_t live_bytes;
+    _Atomic uint64_t allocation_count;
+    _Atomic uint64_t allocated_bytes;
+};
 
-static uintptr_t _align_up(uintptr_t value, size_t align) {
-    core_assert(_is_power_of_two(align));
-    size_t mod = value & (align - 1);
-    if (mod != 0) {
-        value += align - mod;
-    }
-    return value;
-}
+typedef struct tracking_allocator_t tracking_allocator_t;
+struct tracking_allocator_t {
+    allocator_t allocator;
+    _tracking_shard_t shards[TRACKING_SHARD_COUNT];
+    _Atomic int64_t live_bytes;
+    _Atomic int64_t peak_bytes;
+    atomic_flag site_lock;
+    _Atomic uint32_t site_count;
+    _tracking_site_t sites[TRACKING_MAX_SITES];
+};
 
-void* arena_push_aligned(arena_t* arena, size_t size, size_t align) {
-    uintptr_t current_ptr = (uintptr_t) arena->memory + arena->position;
-    uintptr_t aligned_ptr = _align_up(current_ptr, align);
-    uintptr_t position = aligned_ptr - (uintptr_t) arena->memory;
-    if (position + size > arena->capacity) {
-        return NULL;
-    }
-    arena->last_position = position;
-    arena->position = position + size;
-    return &arena->memory[position];
-}
+// Bucket i counts allocations with a size in [2^i, 2^(i+1)).
+typedef struct tracking_stats_t tracking_stats_t;
+struct tracking_stats_t {
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+    uint64_t allocation_count;
+    uint64_t free_count;
+    uint64_t realloc_count;
+    uint64_t allocated_bytes;
+    uint64_t histogram[TRACKING_HISTOGRAM_BUCKETS];
+};
 
-void* arena_push(arena_t* arena, size_t size) {
-    return arena_push_aligned(arena, size, sizeof(void*));
-}
+typedef struct tracking_site_stats_t tracking_site_stats_t;
+struct tracking_site_stats_t {
+    const char* file;
+    int32_t line;
+    uint64_t live_bytes;
+    uint64_t allocation_count;
+    uint64_t allocated_bytes;
+};
 
-void arena_reset(arena_t* arena) {
-    arena->position = sizeof(arena_t);
-    arena->last_position = sizeof(arena_t);
-}
+extern tracking_allocator_t* tracking_allocator_create(allocator_t allocator);
+extern void tracking_allocator_destroy(tracking_allocator_t** tracker);
+extern allocator_t tracking_allocator(tracking_allocator_t* tracker);
 
-arena_scope_t arena_scope_begin(arena_t* arena) {
-    return (arena_scope_t) {
-        .arena = arena,
-        .position = arena->position,
-        .last_position = arena->last_position,
-    };
-}
+extern void tracking_allocator_snapshot(tracking_allocator_t* tracker, tracking_stats_t* stats);
+// Copies up to 'capacity' sites and returns how many there are in total.
+extern size_t tracking_allocator_sites(tracking_allocator_t* tracker, tracking_site_stats_t* sites, size_t capacity);
 
-void arena_scope_end(arena_scope_t* scope) {
-    arena_t* arena = scope->arena;
-    arena->position = scope->position;
-    arena->last_position = scope->last_position;
-    *scope = (arena_scope_t) {0};
+// The call site is passed through a thread local, so these work with any
+// allocator_t and cost three thread local stores, the site and its clear,
+// when it isn't a tracking allocator.
+extern core_thread_local const char* _tracking_site_file;
+extern core_thread_local int32_t _tracking_site_line;
+
+static inline void* _tracking_site_clear(void* ptr) {
+    _tracking_site_file = NULL;
+    return ptr;
 }
 
+#define core_alloc_site(allocator, size) \
+    _tracking_site_clear((_tracking_site_file = __FILE__, _tracking_site_line = __LINE__, core_alloc((allocator), (size))))
+#define core_realloc_site(allocator, ptr, old_size, new_size) \
+    _tracking_site_clear((_tracking_site_file = __FILE__, _tracking_site_line = __LINE__, core_realloc((allocator), (ptr), (old_size), (new_size))))
+
 // =============================================================================
 // DYNAMIC ARRAY
 // =============================================================================
 
-#define _DYN_ARR_INITIAL_SIZE 8
+#define dyn_arr_t(T) T*
+
+#define DYN_ARR_DEFAULT_GROWTH_FACTOR 2.0f
 
 typedef struct _dyn_arr_header_t _dyn_arr_header_t;
 struct _dyn_arr_header_t {
@@ -322,177 +747,6579 @@ struct _dyn_arr_header_t {
     size_t element_size;
     size_t capacity;
     size_t length;
+    float growth_factor;
 };
 
-static inline void* _header_to_dyn_arr(_dyn_arr_header_t* header) {
-    return &header[1];
-}
-
 static inline _dyn_arr_header_t* _dyn_arr_to_header(const void* array) {
     return &((_dyn_arr_header_t*) array)[-1];
 }
 
-void* dyn_arr_create(allocator_t allocator, size_t element_size) {
-    _dyn_arr_header_t* header = core_alloc(allocator, sizeof(_dyn_arr_header_t) + element_size * _DYN_ARR_INITIAL_SIZE);
-    *header = (_dyn_arr_header_t) {
-        .allocator = allocator,
-        .element_size = element_size,
-        .capacity = _DYN_ARR_INITIAL_SIZE,
-        .length = 0,
-    };
+extern void* dyn_arr_create(allocator_t allocator, size_t element_size);
+extern void* dyn_arr_create_with_capacity(allocator_t allocator, size_t element_size, size_t capacity);
+extern void dyn_arr_destroy(void** dyn_arr);
+extern size_t dyn_arr_length(const void* dyn_arr);
+extern size_t dyn_arr_capacity(const void* dyn_arr);
+extern void dyn_arr_clear(void** dyn_arr);
+
+// Grows the capacity to at least 'capacity' elements without over-allocating.
+extern void dyn_arr_reserve(void** dyn_arr, size_t capacity);
+extern void dyn_arr_shrink_to_fit(void** dyn_arr);
+// Capacity is multiplied by 'growth_factor' whenever the array runs out of room.
+extern void dyn_arr_set_growth_factor(void* dyn_arr, float growth_factor);
+
+extern void dyn_arr_insert_arr(void** dyn_arr, size_t index, const void* arr, size_t arr_length);
+extern void dyn_arr_remove_arr(void** dyn_arr, size_t index, size_t count, void* output);
+
+extern void dyn_arr_insert(void** dyn_arr, size_t index, const void* value);
+extern void dyn_arr_remove(void** dyn_arr, size_t index, void* output);
+
+extern void dyn_arr_insert_fast(void** dyn_arr, size_t index, const void* value);
+extern void dyn_arr_remove_fast(void** dyn_arr, size_t index, void* output);
+
+extern void dyn_arr_push(void** dyn_arr, const void* value);
+extern void dyn_arr_pop(void** dyn_arr, void* output);
+
+extern void dyn_arr_push_arr(void** dyn_arr, const void* arr, size_t arr_length);
+extern void dyn_arr_pop_arr(void** dyn_arr, size_t count, void* output);
+
+typedef bool (*dyn_arr_predicate_func_t)(const void* element, void* userdata);
+typedef int (*dyn_arr_compare_func_t)(const void* a, const void* b, void* userdata);
+
+// Bulk removals compact the array in a single pass, moving each run of kept
+// elements once, and preserve the order of what is left.
+// Returns the number of removed elements.
+extern size_t dyn_arr_remove_if(void** dyn_arr, dyn_arr_predicate_func_t predicate, void* userdata);
+// 'sorted_indices' must be strictly increasing.
+extern void dyn_arr_remove_indices(void** dyn_arr, const size_t* sorted_indices, size_t count);
+// Keeps the first of every run of equal elements. A NULL compare compares bytes.
+extern size_t dyn_arr_dedup_sorted(void** dyn_arr, dyn_arr_compare_func_t compare, void* userdata);
+// Replaces 'count' elements at 'index' with 'arr', or zeroes if 'arr' is NULL.
+extern void dyn_arr_splice(void** dyn_arr, size_t index, size_t count, const void* arr, size_t arr_length);
+
+// Typed fast paths. The element is stored with a plain assignment and only a
+// full array calls out of line to grow. 'arr' is evaluated more than once,
+// so it must be a plain variable of the array's element pointer type.
+extern void _dyn_arr_ensure_capacity(void** dyn_arr, size_t length);
+
+static inline void _dyn_arr_reserve_one(void** dyn_arr) {
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    if (header->length == header->capacity) {
+        _dyn_arr_ensure_capacity(dyn_arr, 1);
+    }
+}
+
+static inline size_t _dyn_arr_pop_index(const void* dyn_arr) {
+    _dyn_arr_header_t* header = _dyn_arr_to_header(dyn_arr);
+    core_assert_msg(header->length > 0, "Index out of bounds");
+    return --header->length;
+}
+
+static inline size_t _dyn_arr_checked_index(const void* dyn_arr, size_t index) {
+    core_assert_msg(index < _dyn_arr_to_header(dyn_arr)->length, "Index out of bounds");
+    return index;
+}
+
+// Growing happens before 'arr' is indexed, as it may move the array.
+#define dyn_arr_push_t(arr, value) \
+    (_dyn_arr_reserve_one((void**) &(arr)), (arr)[_dyn_arr_to_header(arr)->length++] = (value))
+// Only valid while the capacity is known to suffice, e.g. after dyn_arr_reserve.
+#define dyn_arr_push_unchecked(arr, value) ((arr)[_dyn_arr_to_header(arr)->length++] = (value))
+#define dyn_arr_pop_t(arr) ((arr)[_dyn_arr_pop_index(arr)])
+#define dyn_arr_get_t(arr, index) ((arr)[_dyn_arr_checked_index((arr), (index))])
+
+#define DYN_ARR_NOT_FOUND SIZE_MAX
+
+#ifndef DYN_ARR_PARALLEL_SORT_THRESHOLD
+#define DYN_ARR_PARALLEL_SORT_THRESHOLD 65536
+#endif
+
+// Introsort: quicksort around a median of three, heapsort once recursion gets
+// too deep and insertion sort for short ranges. Not stable. Elements of 1, 2,
+// 4, 8 and 16 bytes are swapped as whole words rather than byte by byte.
+extern void dyn_arr_sort(void* dyn_arr, dyn_arr_compare_func_t compare, void* userdata);
+// Sorts chunks on the job system and merges them in parallel, with every merge
+// split into independent slices. Falls back to dyn_arr_sort below
+// DYN_ARR_PARALLEL_SORT_THRESHOLD elements or without a running job system.
+// Not stable, and 'compare' is called from several threads at once.
+extern void dyn_arr_sort_parallel(void* dyn_arr, dyn_arr_compare_func_t compare, void* userdata);
+
+typedef enum dyn_arr_key_type_t {
+    DYN_ARR_KEY_U32,
+    DYN_ARR_KEY_U64,
+    DYN_ARR_KEY_I32,
+    DYN_ARR_KEY_I64,
+    DYN_ARR_KEY_F32,
+    DYN_ARR_KEY_F64,
+} dyn_arr_key_type_t;
+
+// Stable LSD radix sort by the number at 'key_offset' in every element, one
+// byte per pass, skipping bytes all keys share. The second buffer comes from
+// a scratch arena. Negative zero sorts before zero and NaNs land at the ends
+// according to their sign.
+extern void dyn_arr_radix_sort(void* dyn_arr, dyn_arr_key_type_t key_type, size_t key_offset);
+
+// Searches an array sorted by 'compare', which is called with an element first
+// and 'key' second. lower_bound returns the first element not less than 'key'
+// or the length, binary_search an equal element or DYN_ARR_NOT_FOUND.
+extern size_t dyn_arr_lower_bound(const void* dyn_arr, const void* key, dyn_arr_compare_func_t compare, void* userdata);
+extern size_t dyn_arr_binary_search(const void* dyn_arr, const void* key, dyn_arr_compare_func_t compare, void* userdata);
+
+// =============================================================================
+// SOA ARRAY
+// =============================================================================
+
+// Structure of arrays: each column is a contiguous array of one field, all
+// sharing a length and capacity and living in a single allocation. Columns
+// start on SOA_ARR_COLUMN_ALIGN boundaries so loops over them can use aligned
+// vector loads. Column pointers move whenever the array grows.
+#define SOA_ARR_MAX_COLUMNS 16
+#define SOA_ARR_COLUMN_ALIGN 64
+
+typedef struct soa_arr_t soa_arr_t;
+struct soa_arr_t {
+    allocator_t allocator;
+    uint8_t* memory;
+    size_t allocation_size;
+    size_t length;
+    size_t capacity;
+    float growth_factor;
+    uint32_t column_count;
+    size_t column_sizes[SOA_ARR_MAX_COLUMNS];
+    uint8_t* columns[SOA_ARR_MAX_COLUMNS];
+};
+
+extern soa_arr_t* soa_arr_create(allocator_t allocator, const size_t* column_sizes, uint32_t column_count);
+extern void soa_arr_destroy(soa_arr_t** arr);
+extern size_t soa_arr_length(const soa_arr_t* arr);
+extern size_t soa_arr_capacity(const soa_arr_t* arr);
+extern void soa_arr_clear(soa_arr_t* arr);
+extern void soa_arr_reserve(soa_arr_t* arr, size_t capacity);
+extern void soa_arr_set_growth_factor(soa_arr_t* arr, float growth_factor);
+
+// Appends a row and returns its index. 'values' holds one pointer per column
+// to copy from; a NULL array or NULL entry zeroes the field instead.
+extern size_t soa_arr_push(soa_arr_t* arr, const void* const* values);
+// Moves the last row into 'index' in every column.
+extern void soa_arr_remove_fast(soa_arr_t* arr, size_t index);
+extern void soa_arr_pop(soa_arr_t* arr);
+
+static inline void* soa_arr_column(const soa_arr_t* arr, uint32_t column) {
+    core_assert_msg(column < arr->column_count, "Column out of bounds");
+    return arr->columns[column];
+}
+
+static inline void* _soa_arr_typed_column(const soa_arr_t* arr, uint32_t column, size_t size) {
+    core_assert_msg(column < arr->column_count && arr->column_sizes[column] == size, "Type does not match the column");
+    return arr->columns[column];
+}
+
+static inline size_t _soa_arr_checked_index(const soa_arr_t* arr, size_t index) {
+    core_assert_msg(index < arr->length, "Index out of bounds");
+    return index;
+}
+
+// Typed column access. The type must match the column's size.
+#define soa_arr_column_t(arr, T, column) ((T*) _soa_arr_typed_column((arr), (column), sizeof(T)))
+#define soa_arr_get_t(arr, T, column, index) \
+    (soa_arr_column_t((arr), T, (column))[_soa_arr_checked_index((arr), (index))])
+
+// =============================================================================
+// SEGMENTED ARRAY
+// =============================================================================
+
+// Array of geometrically growing chunks, each twice the size of the one before,
+// so elements never move once appended and pointers to them stay valid until
+// the array is destroyed. Chunks come from 'allocator'; pass arena_allocator
+// or concurrent_arena_allocator to carve them from an arena.
+//
+// seg_arr_push_concurrent may be called from any number of threads at once,
+// given a thread safe allocator, while other threads read elements below
+// seg_arr_length. Every other function needs exclusive access, except that
+// a single thread calling seg_arr_push may also run alongside readers.
+#define SEG_ARR_MAX_CHUNKS 48
+#define SEG_ARR_DEFAULT_FIRST_CHUNK 16
+
+typedef struct seg_arr_t seg_arr_t;
+struct seg_arr_t {
+    allocator_t allocator;
+    size_t element_size;
+    uint32_t first_chunk_log2;
+    _Atomic(uint8_t*) chunks[SEG_ARR_MAX_CHUNKS];
+    // Appenders claim indices from 'reserved' and publish them to readers
+    // through 'length' in index order. Both sit on their own cache lines,
+    // away from the chunk pointers every reader loads.
+    uint8_t padding0[64];
+    _Atomic size_t reserved;
+    uint8_t padding1[64 - sizeof(size_t)];
+    _Atomic size_t length;
+    uint8_t padding2[64 - sizeof(size_t)];
+};
+
+// 'first_chunk' is the power of two capacity of the first chunk, or 0 for
+// SEG_ARR_DEFAULT_FIRST_CHUNK.
+extern seg_arr_t* seg_arr_create(allocator_t allocator, size_t element_size, size_t first_chunk);
+extern void seg_arr_destroy(seg_arr_t** arr);
+extern size_t seg_arr_length(const seg_arr_t* arr);
+// Forgets the elements but keeps the chunks for reuse.
+extern void seg_arr_clear(seg_arr_t* arr);
+
+// Appends a copy of 'value', or zeroes if it is NULL, and returns its address.
+extern void* seg_arr_push(seg_arr_t* arr, const void* value);
+extern void* seg_arr_push_concurrent(seg_arr_t* arr, const void* value);
+
+extern void* seg_arr_get(const seg_arr_t* arr, size_t index);
+// Returns the element at 'index' and stores how many elements follow it
+// contiguously in the same chunk, itself included, for chunk-wise loops.
+extern void* seg_arr_span(const seg_arr_t* arr, size_t index, size_t* count);
+
+#define seg_arr_get_t(arr, T, index) (*(T*) seg_arr_get((arr), (index)))
+#define seg_arr_push_t(arr, T, value) ((T*) seg_arr_push((arr), &(T){value}))
+#define seg_arr_push_concurrent_t(arr, T, value) ((T*) seg_arr_push_concurrent((arr), &(T){value}))
+
+// =============================================================================
+// SLOT MAP
+// =============================================================================
+
+// Values packed densely in a dyn_arr for iteration, addressed through handles
+// that combine a slot index with the slot's generation. Removing a value bumps
+// the generation, so stale handles are rejected instead of aliasing whatever
+// reuses the slot. Removal moves the last value into the hole, which changes
+// dense indices and value pointers but never handles.
+//
+// Handles are 64 bit with 32 bits of index and generation each. Define
+// CORE_SLOT_MAP_HANDLE_32 for 32 bit handles with a 20 bit index and a 12 bit
+// generation. Slots whose generation runs out are retired rather than reused.
+// A zeroed handle is never valid.
+#if defined(CORE_SLOT_MAP_HANDLE_32)
+typedef uint32_t slot_handle_t;
+#define SLOT_MAP_INDEX_BITS 20
+#else
+typedef uint64_t slot_handle_t;
+#define SLOT_MAP_INDEX_BITS 32
+#endif
+
+#define SLOT_HANDLE_NULL ((slot_handle_t) 0)
+
+typedef struct _slot_map_slot_t _slot_map_slot_t;
+struct _slot_map_slot_t {
+    // Dense index while occupied, next free slot otherwise.
+    uint32_t index;
+    // Odd while occupied.
+    uint32_t generation;
+};
+
+typedef struct slot_map_t slot_map_t;
+struct slot_map_t {
+    allocator_t allocator;
+    size_t element_size;
+    void* values;
+    dyn_arr_t(uint32_t) dense_slots;
+    dyn_arr_t(_slot_map_slot_t) slots;
+    uint32_t free_head;
+};
+
+extern slot_map_t* slot_map_create(allocator_t allocator, size_t element_size);
+extern void slot_map_destroy(slot_map_t** map);
+extern size_t slot_map_length(const slot_map_t* map);
+// Removes every value and invalidates every handle.
+extern void slot_map_clear(slot_map_t* map);
+
+// Copies 'value' in, or zeroes if it is NULL, and returns its handle.
+extern slot_handle_t slot_map_insert(slot_map_t* map, const void* value);
+// Returns the value, or NULL if the handle is stale.
+extern void* slot_map_get(const slot_map_t* map, slot_handle_t handle);
+extern bool slot_map_contains(const slot_map_t* map, slot_handle_t handle);
+extern bool slot_map_remove(slot_map_t* map, slot_handle_t handle, void* output);
+
+// The dense values as a dyn_arr of slot_map_length elements, and the handle
+// of the value at a dense index.
+extern void* slot_map_values(const slot_map_t* map);
+extern slot_handle_t slot_map_handle_at(const slot_map_t* map, size_t dense_index);
+
+#define slot_map_create_t(allocator, T) slot_map_create((allocator), sizeof(T))
+#define slot_map_insert_t(map, T, value) slot_map_insert((map), &(T){value})
+#define slot_map_get_t(map, T, handle) ((T*) slot_map_get((map), (handle)))
+
+// =============================================================================
+// HASH MAP
+// =============================================================================
+
+// Open addressing map in the style of Swiss tables. A control byte per slot
+// holds 7 bits of the hash, or marks the slot as empty or deleted, and
+// lookups compare a whole group of control bytes at once with SSE2, NEON or
+// plain 64 bit arithmetic before touching any keys. Keys and values are
+// stored inline and copied by size; a NULL hash or eq uses hash_bytes and
+// memcmp. Pointers returned into the map are invalidated by insertions.
+// Define CORE_HASH_MAP_NO_SIMD to always use the portable group probing.
+typedef uint64_t (*hash_map_hash_func_t)(const void* key, size_t key_size);
+typedef bool (*hash_map_eq_func_t)(const void* a, const void* b, size_t key_size);
+
+typedef struct hash_map_t hash_map_t;
+struct hash_map_t {
+    allocator_t allocator;
+    size_t key_size;
+    size_t value_size;
+    size_t value_offset;
+    size_t slot_size;
+    hash_map_hash_func_t hash;
+    hash_map_eq_func_t eq;
+    uint8_t* slots;
+    uint8_t* ctrl;
+    size_t capacity;
+    size_t length;
+    // Insertions left before the load factor of 7/8 is reached.
+    size_t growth_left;
+};
+
+extern uint64_t hash_bytes(const void* data, size_t size);
+
+extern hash_map_t* hash_map_create(allocator_t allocator, size_t key_size, size_t value_size, hash_map_hash_func_t hash, hash_map_eq_func_t eq);
+extern void hash_map_destroy(hash_map_t** map);
+extern size_t hash_map_length(const hash_map_t* map);
+extern void hash_map_clear(hash_map_t* map);
+// Makes room for 'count' entries without further growth.
+extern void hash_map_reserve(hash_map_t* map, size_t count);
+
+// Returns a pointer to the value stored for 'key' or NULL.
+extern void* hash_map_get(const hash_map_t* map, const void* key);
+extern bool hash_map_contains(const hash_map_t* map, const void* key);
+// Inserts or overwrites the value for 'key' and returns a pointer to it. A
+// NULL value zero initialises new entries and leaves existing ones untouched.
+extern void* hash_map_insert(hash_map_t* map, const void* key, const void* value);
+extern bool hash_map_remove(hash_map_t* map, const void* key, void* output);
+
+// Iterates the entries in slot order, starting with '*iterator' set to 0.
+// 'key' or 'value' may be NULL.
+extern bool hash_map_next(const hash_map_t* map, size_t* iterator, void** key, void** value);
+
+// Typed wrappers. Keys and values are passed by value through compound
+// literals, so they have to be scalars; use the untyped API for structs.
+#define hash_map_create_t(allocator, K, V) \
+    hash_map_create((allocator), sizeof(K), sizeof(V), NULL, NULL)
+#define hash_map_get_t(map, K, V, key) ((V*) hash_map_get((map), &(K){key}))
+#define hash_map_contains_t(map, K, key) hash_map_contains((map), &(K){key})
+#define hash_map_insert_t(map, K, V, key, value) ((V*) hash_map_insert((map), &(K){key}, &(V){value}))
+#define hash_map_remove_t(map, K, key) hash_map_remove((map), &(K){key}, NULL)
+
+// =============================================================================
+// STRING
+// =============================================================================
+
+// Length carrying view into memory owned by someone else, usually an arena.
+// Views are not NUL terminated unless they come from str_format, str_copy or
+// a builder; print them with "%.*s" and str_arg.
+typedef struct str_t str_t;
+struct str_t {
+    const char* data;
+    size_t length;
+};
+
+#define STR_NOT_FOUND SIZE_MAX
+
+#define str_lit(literal) ((str_t) { (literal), sizeof(literal) - 1 })
+#define str_arg(str) (int) (str).length, (str).data
+
+extern str_t str_from_cstr(const char* cstr);
+// NUL terminated copies.
+extern str_t str_copy(arena_t* arena, str_t str);
+extern const char* str_to_cstr(arena_t* arena, str_t str);
+extern str_t str_format(arena_t* arena, const char* format, ...);
+extern str_t str_format_v(arena_t* arena, const char* format, va_list args);
+
+// Indices are clamped to the string.
+extern str_t str_slice(str_t str, size_t start, size_t end);
+extern str_t str_trim(str_t str);
+
+extern bool str_eq(str_t a, str_t b);
+extern int str_compare(str_t a, str_t b);
+extern bool str_starts_with(str_t str, str_t prefix);
+extern bool str_ends_with(str_t str, str_t suffix);
+extern uint64_t str_hash(str_t str);
+
+// Return the index of the first or last occurrence, or STR_NOT_FOUND.
+extern size_t str_find(str_t str, str_t needle);
+extern size_t str_find_char(str_t str, char c);
+extern size_t str_find_last_char(str_t str, char c);
+
+// Splits off the next token up to 'delimiter' from '*remaining'. Consecutive
+// delimiters produce empty tokens; returns false once every token has been
+// produced.
+//
+//     str_t remaining = str_lit("a,b,,c");
+//     str_t token;
+//     while (str_split_next(&remaining, ',', &token)) { ... }
+extern bool str_split_next(str_t* remaining, char delimiter, str_t* token);
+
+// Appends into a single allocation that grows in place while it is the top
+// of the arena. Pushing anything else before the builder ends makes the next
+// growth copy. Temporaries belong in a scratch arena.
+typedef struct str_builder_t str_builder_t;
+struct str_builder_t {
+    arena_t* arena;
+    char* data;
+    size_t length;
+    size_t capacity;
+};
+
+extern str_builder_t str_builder_begin(arena_t* arena, size_t capacity);
+extern void str_builder_append(str_builder_t* builder, str_t str);
+extern void str_builder_append_char(str_builder_t* builder, char c);
+extern void str_builder_append_format(str_builder_t* builder, const char* format, ...);
+extern void str_builder_append_format_v(str_builder_t* builder, const char* format, va_list args);
+// NUL terminates the result and returns unused capacity to the arena.
+extern str_t str_builder_end(str_builder_t* builder);
+
+// =============================================================================
+// JOB SYSTEM
+// =============================================================================
+
+// Fixed pool of worker threads, each owning a Chase-Lev work stealing deque.
+// Jobs submitted from a worker go to its own deque, jobs from other threads
+// to a shared queue. Every job runs inside a scope on the executing thread's
+// scratch arena, available through job_arena and rewound when the job
+// returns. Waiting threads execute jobs instead of blocking, so jobs may wait
+// on other jobs. Without a running job system jobs run inline.
+#define JOB_DEQUE_CAPACITY 4096
+#define JOB_QUEUE_CAPACITY 4096
+
+typedef void (*job_func_t)(void* data);
+typedef void (*job_range_func_t)(size_t begin, size_t end, void* data);
+
+// Counts unfinished jobs for fork-join. Zero initialise before use.
+typedef struct job_counter_t job_counter_t;
+struct job_counter_t {
+    _Atomic int64_t pending;
+};
+
+// A 'worker_count' of 0 starts one worker per core, minus the calling thread.
+extern bool job_system_start(allocator_t allocator, uint32_t worker_count);
+// Finishes queued jobs and joins the workers.
+extern void job_system_stop(void);
+extern uint32_t job_system_worker_count(void);
+// Index of the calling worker, or UINT32_MAX for threads outside the pool.
+extern uint32_t job_worker_index(void);
+
+// Adds the job to 'counter' if it isn't NULL. Runs the job inline when the
+// queue is full.
+extern void job_run(job_func_t func, void* data, job_counter_t* counter);
+// Executes other jobs until every job added to 'counter' has finished.
+extern void job_wait(job_counter_t* counter);
+// Calls 'func' over disjoint subranges covering [0, count) and returns once
+// all of them are done. Ranges are split in halves on demand, so idle workers
+// steal large chunks first, down to 'min_chunk' indices.
+extern void parallel_for(size_t count, size_t min_chunk, job_range_func_t func, void* data);
+// Scratch arena of the current job. Allocations are released when it returns.
+extern arena_t* job_arena(void);
+
+// =============================================================================
+// QUEUE
+// =============================================================================
+
+// Bounded ring queues over elements copied by size. Capacity must be a power
+// of two, and the indices each side writes live on their own cache lines.
+// Batch operations move up to 'count' elements with a single index update and
+// return how many moved.
+
+// Single producer, single consumer. Every operation is wait-free. Each side
+// keeps a cached copy of the other's index and only reloads it when the
+// queue looks full or empty.
+typedef struct spsc_queue_t spsc_queue_t;
+struct spsc_queue_t {
+    allocator_t allocator;
+    uint8_t* buffer;
+    size_t element_size;
+    size_t capacity;
+    uint8_t padding0[64];
+    // Producer side.
+    _Atomic size_t tail;
+    size_t cached_head;
+    uint8_t padding1[64 - 2 * sizeof(size_t)];
+    // Consumer side.
+    _Atomic size_t head;
+    size_t cached_tail;
+    uint8_t padding2[64 - 2 * sizeof(size_t)];
+};
+
+extern spsc_queue_t* spsc_queue_create(allocator_t allocator, size_t element_size, size_t capacity);
+extern void spsc_queue_destroy(spsc_queue_t** queue);
+// Exact when called from either side, a snapshot from anywhere else.
+extern size_t spsc_queue_length(spsc_queue_t* queue);
+extern bool spsc_queue_push(spsc_queue_t* queue, const void* value);
+extern bool spsc_queue_pop(spsc_queue_t* queue, void* output);
+extern size_t spsc_queue_push_n(spsc_queue_t* queue, const void* values, size_t count);
+extern size_t spsc_queue_pop_n(spsc_queue_t* queue, void* output, size_t count);
+
+// Multi-producer, multi-consumer, after Dmitry Vyukov's bounded queue. Every
+// cell carries a sequence number telling producers and consumers whose turn
+// it is, so each side claims positions with a compare-and-swap and hands the
+// cell over with a release store. Operations fail instead of waiting when the
+// queue is full or empty.
+typedef struct mpmc_queue_t mpmc_queue_t;
+struct mpmc_queue_t {
+    allocator_t allocator;
+    uint8_t* cells;
+    size_t element_size;
+    size_t capacity;
+    size_t cell_size;
+    size_t data_offset;
+    uint8_t padding0[64];
+    _Atomic size_t enqueue_position;
+    uint8_t padding1[64 - sizeof(size_t)];
+    _Atomic size_t dequeue_position;
+    uint8_t padding2[64 - sizeof(size_t)];
+};
+
+extern mpmc_queue_t* mpmc_queue_create(allocator_t allocator, size_t element_size, size_t capacity);
+extern void mpmc_queue_destroy(mpmc_queue_t** queue);
+// Snapshot, may be stale by the time it returns.
+extern size_t mpmc_queue_length(mpmc_queue_t* queue);
+extern bool mpmc_queue_push(mpmc_queue_t* queue, const void* value);
+extern bool mpmc_queue_pop(mpmc_queue_t* queue, void* output);
+// Claims a run of consecutive cells at once. Elements of one batch stay in
+// order, but batches from different producers are not interleaved.
+extern size_t mpmc_queue_push_n(mpmc_queue_t* queue, const void* values, size_t count);
+extern size_t mpmc_queue_pop_n(mpmc_queue_t* queue, void* output, size_t count);
+
+// Typed wrappers. Pushed values are the initializer of a compound literal,
+// so they can be a scalar or the members of a struct, as in
+// mpmc_queue_push_t(queue, vec2_t, 1.0f, 2.0f) or (queue, vec2_t, .y = 2.0f).
+// Outputs and batches are checked to point at 'T'.
+#define spsc_queue_create_t(allocator, T, capacity) spsc_queue_create((allocator), sizeof(T), (capacity))
+#define spsc_queue_push_t(queue, T, ...) spsc_queue_push((queue), &(T){__VA_ARGS__})
+#define spsc_queue_pop_t(queue, T, output) spsc_queue_pop((queue), (T*){output})
+#define spsc_queue_push_n_t(queue, T, values, count) spsc_queue_push_n((queue), (const T*){values}, (count))
+#define spsc_queue_pop_n_t(queue, T, output, count) spsc_queue_pop_n((queue), (T*){output}, (count))
+#define mpmc_queue_create_t(allocator, T, capacity) mpmc_queue_create((allocator), sizeof(T), (capacity))
+#define mpmc_queue_push_t(queue, T, ...) mpmc_queue_push((queue), &(T){__VA_ARGS__})
+#define mpmc_queue_pop_t(queue, T, output) mpmc_queue_pop((queue), (T*){output})
+#define mpmc_queue_push_n_t(queue, T, values, count) mpmc_queue_push_n((queue), (const T*){values}, (count))
+#define mpmc_queue_pop_n_t(queue, T, output, count) mpmc_queue_pop_n((queue), (T*){output}, (count))
+
+// =============================================================================
+// PROFILER
+// =============================================================================
+
+// Instrumentation zones, compiled out unless CORE_PROFILE is defined. Zones
+// nest per thread and read the CPU's counter (rdtsc on x86, cntvct on ARM64,
+// the monotonic clock elsewhere), recording into a ring per thread carved
+// from the profiler's arena, so recording never takes a lock. A full ring
+// drops events until the next flush. Flushes drain the rings into a Chrome
+// trace-event JSON file, viewable in Perfetto or chrome://tracing, or a
+// compact binary file that prof_binary_to_chrome converts later. Count,
+// total, min and max per zone name are kept regardless of the trace.
+//
+// Zone names must be string literals or otherwise outlive the profiler.
+#define PROF_MAX_DEPTH 64
+#define PROF_MAX_ZONES 256
+#define PROF_DEFAULT_EVENT_CAPACITY 65536
+
+#if defined(CORE_PROFILE)
+typedef enum prof_format_t {
+    PROF_FORMAT_CHROME_JSON,
+    PROF_FORMAT_BINARY,
+} prof_format_t;
+
+typedef struct prof_zone_stats_t prof_zone_stats_t;
+struct prof_zone_stats_t {
+    const char* name;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+};
+
+// 'events_per_thread' must be a power of two, or 0 for the default.
+extern bool prof_init(size_t events_per_thread);
+// Call once no thread records zones anymore.
+extern void prof_shutdown(void);
+
+extern bool prof_trace_open(const char* path, prof_format_t format);
+// Moves every recorded event into the trace, or discards them if none is open.
+extern void prof_trace_flush(void);
+extern void prof_trace_close(void);
+extern uint64_t prof_dropped_count(void);
+extern bool prof_binary_to_chrome(allocator_t allocator, const char* binary_path, const char* json_path);
+
+// Merges the zones of every thread by name and returns how many were stored.
+extern size_t prof_stats(prof_zone_stats_t* stats, size_t capacity);
+// Logs one line per zone, slowest total first.
+extern void prof_log_stats(log_level_t level);
+
+extern void _prof_zone_begin(const char* name);
+extern void _prof_zone_end(void);
+
+#define prof_zone_begin(name) _prof_zone_begin(name)
+#define prof_zone_end() _prof_zone_end()
+#else
+#define prof_zone_begin(name) ((void) sizeof(name))
+#define prof_zone_end() ((void) 0)
+#endif
+
+#ifdef CORE_IMPLEMENTATION
+
+// TODO: Remove this CRT dependency
+#include <string.h>
+#include <stdio.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+#if !defined(CORE_HASH_MAP_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define _HASH_MAP_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define _HASH_MAP_NEON
+#endif
+#endif
+
+#if defined(CORE_PROFILE)
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define _PROF_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define _PROF_RDTSC
+#endif
+#endif
+
+// =============================================================================
+// UTILITY
+// =============================================================================
+
+static bool _is_power_of_two(uintptr_t value) {
+    return (value & (value - 1)) == 0;
+}
+
+static uintptr_t _align_up(uintptr_t value, size_t align) {
+    core_assert(_is_power_of_two(align));
+    size_t mod = value & (align - 1);
+    if (mod != 0) {
+        value += align - mod;
+    }
+    return value;
+}
+
+static uint32_t _log2_floor(uint64_t value) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    uint32_t result = 0;
+    while (value >>= 1) {
+        result++;
+    }
+    return result;
+#endif
+}
+
+// 'value' must not be 0.
+static uint32_t _count_trailing_zeros(uint64_t value) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#else
+    uint32_t result = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        result++;
+    }
+    return result;
+#endif
+}
+
+// Largest power of two dividing 'size', capped at 16, as the alignment for
+// elements known only by size.
+static size_t _natural_alignment(size_t size) {
+    size_t align = size & (~size + 1);
+    return align == 0 || align > 16 ? 16 : align;
+}
+
+// =============================================================================
+// OS
+// =============================================================================
+
+static size_t _os_page_size(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static void* _os_reserve(size_t size) {
+#if defined(_WIN32)
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void* ptr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return ptr == MAP_FAILED ? NULL : ptr;
+#endif
+}
+
+static bool _os_commit(void* ptr, size_t size) {
+#if defined(_WIN32)
+    return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+    return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+static void _os_decommit(void* ptr, size_t size) {
+#if defined(_WIN32)
+    VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+    // Protecting the range again keeps _os_commit meaningful.
+    madvise(ptr, size, MADV_DONTNEED);
+    mprotect(ptr, size, PROT_NONE);
+#endif
+}
+
+static void _os_release(void* ptr, size_t size) {
+#if defined(_WIN32)
+    unused(size);
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+static void* _os_alloc_pages(size_t size) {
+#if defined(_WIN32)
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return ptr == MAP_FAILED ? NULL : ptr;
+#endif
+}
+
+#if !defined(_WIN32)
+// Binds a mapping to a NUMA node before its pages are faulted in. Succeeds
+// without doing anything where binding isn't supported.
+static bool _os_bind_node(void* ptr, size_t size, uint32_t node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    if (node >= 64) {
+        return false;
+    }
+    // MPOL_BIND from numaif.h, which isn't always installed.
+    unsigned long nodemask = 1ul << node;
+    return syscall(SYS_mbind, ptr, size, 2, &nodemask, 64, 0) == 0;
+#else
+    unused(ptr);
+    unused(size);
+    unused(node);
+    return true;
+#endif
+}
+#endif
+
+// Reserves and commits 'size' bytes of explicit huge pages, bound to 'node'
+// if 'bind_node' is set, or returns NULL. Without MAP_NORESERVE the mapping
+// fails up front when the pool is too small instead of faulting later.
+static void* _os_alloc_huge_pages(size_t size, bool bind_node, uint32_t node) {
+#if defined(_WIN32)
+    size_t large_page_size = GetLargePageMinimum();
+    if (large_page_size == 0 || size % large_page_size != 0) {
+        return NULL;
+    }
+    DWORD type = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+    if (bind_node) {
+        return VirtualAllocExNuma(GetCurrentProcess(), NULL, size, type, PAGE_READWRITE, node);
+    }
+    return VirtualAlloc(NULL, size, type, PAGE_READWRITE);
+#elif defined(MAP_HUGETLB)
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    if (bind_node && !_os_bind_node(ptr, size, node)) {
+        munmap(ptr, size);
+        return NULL;
+    }
+    return ptr;
+#else
+    unused(size);
+    unused(bind_node);
+    unused(node);
+    return NULL;
+#endif
+}
+
+// Reserves 'size' bytes starting at a multiple of 'align'.
+static void* _os_reserve_aligned(size_t size, size_t align) {
+#if defined(_WIN32)
+    // Parts of a reservation can't be released, so retry at a hinted address.
+    uint8_t* ptr = VirtualAlloc(NULL, size + align, MEM_RESERVE, PAGE_NOACCESS);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    uint8_t* aligned = (uint8_t*) _align_up((uintptr_t) ptr, align);
+    VirtualFree(ptr, 0, MEM_RELEASE);
+    ptr = VirtualAlloc(aligned, size, MEM_RESERVE, PAGE_NOACCESS);
+    return ptr != NULL ? ptr : _os_reserve(size);
+#else
+    uint8_t* ptr = _os_reserve(size + align);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    uint8_t* aligned = (uint8_t*) _align_up((uintptr_t) ptr, align);
+    if (aligned != ptr) {
+        munmap(ptr, aligned - ptr);
+    }
+    munmap(aligned + size, ptr + align - aligned);
+    return aligned;
+#endif
+}
+
+static void _os_advise_huge_pages(void* ptr, size_t size) {
+#if defined(MADV_HUGEPAGE)
+    madvise(ptr, size, MADV_HUGEPAGE);
+#else
+    unused(ptr);
+    unused(size);
+#endif
+}
+
+// Binds a reservation to a NUMA node before anything is committed. Returns
+// NULL if the reservation or the bind fails.
+static void* _os_reserve_on_node(size_t size, size_t align, uint32_t node) {
+#if defined(_WIN32)
+    unused(align);
+    return VirtualAllocExNuma(GetCurrentProcess(), NULL, size, MEM_RESERVE, PAGE_NOACCESS, node);
+#else
+    void* ptr = _os_reserve_aligned(size, align);
+    if (ptr != NULL && !_os_bind_node(ptr, size, node)) {
+        _os_release(ptr, size);
+        return NULL;
+    }
+    return ptr;
+#endif
+}
+
+// Faults in committed pages without changing their contents.
+static void _os_prefault(void* ptr, size_t size) {
+#if defined(MADV_POPULATE_WRITE)
+    if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    size_t page_size = _os_page_size();
+    volatile uint8_t* bytes = ptr;
+    for (size_t i = 0; i < size; i += page_size) {
+        bytes[i] = bytes[i];
+    }
+}
+
+// Maps a file privately, so writes never reach it. On POSIX the mapping sits
+// at the start of a 'reserve_size' reservation. Windows maps just the file
+// and ignores 'reserve_size'. Returns the mapping size in '*mapped_size' and
+// the file size in '*file_size'.
+static void* _os_map_file(const char* path, size_t reserve_size, bool writable, size_t* mapped_size, size_t* file_size) {
+#if defined(_WIN32)
+    unused(reserve_size);
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, writable ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return NULL;
+    }
+    void* memory = MapViewOfFile(mapping, writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    *file_size = (size_t) size.QuadPart;
+    *mapped_size = *file_size;
+    return memory;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    size_t page_size = _os_page_size();
+    size_t size = (size_t) info.st_size;
+    size_t reserve = _align_up(size > reserve_size ? size : reserve_size, page_size);
+    uint8_t* memory = _os_reserve(reserve);
+    if (memory == NULL) {
+        close(fd);
+        return NULL;
+    }
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* mapped = mmap(memory, size, protection, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        _os_release(memory, reserve);
+        return NULL;
+    }
+    *file_size = size;
+    *mapped_size = reserve;
+    return memory;
+#endif
+}
+
+static void _os_unmap_file(void* ptr, size_t size) {
+#if defined(_WIN32)
+    unused(size);
+    UnmapViewOfFile(ptr);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+static uint64_t _os_wall_clock_ns(void) {
+#if defined(_WIN32)
+    // FILETIME counts 100ns intervals since 1601.
+    FILETIME time;
+    GetSystemTimeAsFileTime(&time);
+    uint64_t ticks = ((uint64_t) time.dwHighDateTime << 32) | time.dwLowDateTime;
+    return (ticks - 116444736000000000ull) * 100;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_REALTIME, &time);
+    return (uint64_t) time.tv_sec * 1000000000ull + (uint64_t) time.tv_nsec;
+#endif
+}
+
+static uint64_t _os_monotonic_ns(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t) ((double) counter.QuadPart * 1e9 / (double) frequency.QuadPart);
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000ull + (uint64_t) time.tv_nsec;
+#endif
+}
+
+static core_thread_local uint64_t t_os_thread_id = 0;
+
+// Cached per thread, as gettid is a system call on every log event otherwise.
+static uint64_t _os_thread_id(void) {
+    if (t_os_thread_id != 0) {
+        return t_os_thread_id;
+    }
+#if defined(_WIN32)
+    t_os_thread_id = GetCurrentThreadId();
+#elif defined(__linux__)
+    t_os_thread_id = (uint64_t) syscall(SYS_gettid);
+#else
+    t_os_thread_id = (uint64_t) (uintptr_t) pthread_self();
+#endif
+    return t_os_thread_id;
+}
+
+static void _os_yield(void) {
+#if defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+static void _os_sleep_ms(uint32_t ms) {
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    struct timespec time = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (long) (ms % 1000) * 1000000,
+    };
+    nanosleep(&time, NULL);
+#endif
+}
+
+// The thread struct must outlive the thread since it's handed to it.
+typedef struct _os_thread_t _os_thread_t;
+struct _os_thread_t {
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    void (*func)(void* data);
+    void* data;
+};
+
+#if defined(_WIN32)
+static DWORD WINAPI _os_thread_entry(LPVOID param) {
+    _os_thread_t* thread = param;
+    thread->func(thread->data);
+    return 0;
+}
+#else
+static void* _os_thread_entry(void* param) {
+    _os_thread_t* thread = param;
+    thread->func(thread->data);
+    return NULL;
+}
+#endif
+
+static bool _os_thread_start(_os_thread_t* thread, void (*func)(void* data), void* data) {
+    thread->func = func;
+    thread->data = data;
+#if defined(_WIN32)
+    thread->handle = CreateThread(NULL, 0, _os_thread_entry, thread, 0, NULL);
+    return thread->handle != NULL;
+#else
+    return pthread_create(&thread->handle, NULL, _os_thread_entry, thread) == 0;
+#endif
+}
+
+static void _os_thread_join(_os_thread_t* thread) {
+#if defined(_WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+}
+
+static uint32_t _os_core_count(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count < 1 ? 1 : (uint32_t) count;
+#endif
+}
+
+// Counting semaphore for parking idle threads.
+typedef struct _os_semaphore_t _os_semaphore_t;
+struct _os_semaphore_t {
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t count;
+#endif
+};
+
+static void _os_semaphore_init(_os_semaphore_t* semaphore) {
+#if defined(_WIN32)
+    semaphore->handle = CreateSemaphoreA(NULL, 0, 0x7fffffff, NULL);
+#else
+    pthread_mutex_init(&semaphore->mutex, NULL);
+    pthread_cond_init(&semaphore->cond, NULL);
+    semaphore->count = 0;
+#endif
+}
+
+static void _os_semaphore_destroy(_os_semaphore_t* semaphore) {
+#if defined(_WIN32)
+    CloseHandle(semaphore->handle);
+#else
+    pthread_cond_destroy(&semaphore->cond);
+    pthread_mutex_destroy(&semaphore->mutex);
+#endif
+}
+
+static void _os_semaphore_post(_os_semaphore_t* semaphore, uint32_t count) {
+#if defined(_WIN32)
+    ReleaseSemaphore(semaphore->handle, (LONG) count, NULL);
+#else
+    pthread_mutex_lock(&semaphore->mutex);
+    semaphore->count += count;
+    pthread_mutex_unlock(&semaphore->mutex);
+    if (count == 1) {
+        pthread_cond_signal(&semaphore->cond);
+    } else {
+        pthread_cond_broadcast(&semaphore->cond);
+    }
+#endif
+}
+
+static void _os_semaphore_wait(_os_semaphore_t* semaphore) {
+#if defined(_WIN32)
+    WaitForSingleObject(semaphore->handle, INFINITE);
+#else
+    pthread_mutex_lock(&semaphore->mutex);
+    while (semaphore->count == 0) {
+        pthread_cond_wait(&semaphore->cond, &semaphore->mutex);
+    }
+    semaphore->count--;
+    pthread_mutex_unlock(&semaphore->mutex);
+#endif
+}
+
+static void* _os_allocator_alloc(size_t size, void* context) {
+    unused(context);
+    return _os_alloc_pages(_align_up(size, _os_page_size()));
+}
+
+static void _os_allocator_free(void* ptr, size_t size, void* context) {
+    unused(context);
+    if (ptr != NULL) {
+        _os_release(ptr, _align_up(size, _os_page_size()));
+    }
+}
+
+static void* _os_allocator_realloc(void* ptr, size_t old_size, size_t new_size, void* context) {
+    size_t page_size = _os_page_size();
+    if (ptr != NULL && _align_up(new_size, page_size) == _align_up(old_size, page_size)) {
+        return ptr;
+    }
+    void* new_ptr = _os_allocator_alloc(new_size, context);
+    if (new_ptr != NULL && ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+        _os_allocator_free(ptr, old_size, context);
+    }
+    return new_ptr;
+}
+
+allocator_t os_allocator(void) {
+    return (allocator_t) {
+        .alloc = _os_allocator_alloc,
+        .realloc = _os_allocator_realloc,
+        .free = _os_allocator_free,
+        .context = NULL,
+    };
+}
+
+// =============================================================================
+// LOGGER
+// =============================================================================
+
+#define MAX_LOGGER_CALLBACK_COUNT 16
+
+typedef struct _logger_callback_t _logger_callback_t;
+struct _logger_callback_t {
+    logger_callback_func_t func;
+    void* userdata;
+    uint32_t level_mask;
+};
+
+typedef struct _logger_flush_callback_t _logger_flush_callback_t;
+struct _logger_flush_callback_t {
+    logger_flush_func_t func;
+    void* userdata;
+};
+
+static _logger_callback_t g_logger_callbacks[MAX_LOGGER_CALLBACK_COUNT] = {0};
+static uint32_t g_logger_callback_count = 0;
+static _logger_flush_callback_t g_logger_flush_callbacks[MAX_LOGGER_CALLBACK_COUNT] = {0};
+static uint32_t g_logger_flush_callback_count = 0;
+static log_level_t g_logger_level = LOG_LEVEL_TRACE;
+static FILE* g_logger_binary_file = NULL;
+// Held while the callback arrays change and while the background thread
+// walks them.
+static atomic_flag g_logger_callback_lock = ATOMIC_FLAG_INIT;
+
+static void _logger_callback_lock(void) {
+    while (atomic_flag_test_and_set_explicit(&g_logger_callback_lock, memory_order_acquire)) {
+        _os_yield();
+    }
+}
+
+static void _logger_callback_unlock(void) {
+    atomic_flag_clear_explicit(&g_logger_callback_lock, memory_order_release);
+}
+
+_Atomic uint32_t _log_level_mask = 0;
+
+static void _logger_update_level_mask(void) {
+    uint32_t callback_mask = 0;
+    for (uint32_t i = 0; i < g_logger_callback_count; i++) {
+        callback_mask |= g_logger_callbacks[i].level_mask;
+    }
+    if (g_logger_binary_file != NULL) {
+        callback_mask = LOG_LEVEL_MASK_ALL;
+    }
+    atomic_store_explicit(&_log_level_mask, callback_mask & LOG_LEVEL_MASK(g_logger_level), memory_order_relaxed);
+}
+
+void logger_register_callback(logger_callback_func_t func, void* userdata) {
+    logger_register_callback_mask(func, userdata, LOG_LEVEL_MASK_ALL);
+}
+
+void logger_register_callback_mask(logger_callback_func_t func, void* userdata, uint32_t level_mask) {
+    core_assert_msg(g_logger_callback_count < MAX_LOGGER_CALLBACK_COUNT, "Maximum amount of logger callbacks of %d has been reached.", MAX_LOGGER_CALLBACK_COUNT);
+    _logger_callback_lock();
+    g_logger_callbacks[g_logger_callback_count] = (_logger_callback_t) {
+        .func = func,
+        .userdata = userdata,
+        .level_mask = level_mask,
+    };
+    g_logger_callback_count++;
+    _logger_update_level_mask();
+    _logger_callback_unlock();
+}
+
+void logger_register_flush_callback(logger_flush_func_t func, void* userdata) {
+    core_assert_msg(g_logger_flush_callback_count < MAX_LOGGER_CALLBACK_COUNT, "Maximum amount of logger flush callbacks of %d has been reached.", MAX_LOGGER_CALLBACK_COUNT);
+    _logger_callback_lock();
+    g_logger_flush_callbacks[g_logger_flush_callback_count] = (_logger_flush_callback_t) {
+        .func = func,
+        .userdata = userdata,
+    };
+    g_logger_flush_callback_count++;
+    _logger_callback_unlock();
+}
+
+// Once this returns the background thread no longer calls into 'userdata'.
+void logger_unregister(void* userdata) {
+    _logger_callback_lock();
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < g_logger_callback_count; i++) {
+        if (g_logger_callbacks[i].userdata != userdata) {
+            g_logger_callbacks[count++] = g_logger_callbacks[i];
+        }
+    }
+    g_logger_callback_count = count;
+
+    count = 0;
+    for (uint32_t i = 0; i < g_logger_flush_callback_count; i++) {
+        if (g_logger_flush_callbacks[i].userdata != userdata) {
+            g_logger_flush_callbacks[count++] = g_logger_flush_callbacks[i];
+        }
+    }
+    g_logger_flush_callback_count = count;
+    _logger_update_level_mask();
+    _logger_callback_unlock();
+}
+
+static void _logger_run_flush_callbacks(void) {
+    _logger_callback_lock();
+    for (uint32_t i = 0; i < g_logger_flush_callback_count; i++) {
+        g_logger_flush_callbacks[i].func(g_logger_flush_callbacks[i].userdata);
+    }
+    if (g_logger_binary_file != NULL) {
+        fflush(g_logger_binary_file);
+    }
+    _logger_callback_unlock();
+}
+
+void logger_set_level(log_level_t level) {
+    g_logger_level = level;
+    _logger_update_level_mask();
+}
+
+log_level_t logger_get_level(void) {
+    return g_logger_level;
+}
+
+static void _log_dispatch(const log_event_t* header, va_list args) {
+    for (uint32_t i = 0; i < g_logger_callback_count; i++) {
+        _logger_callback_t callback = g_logger_callbacks[i];
+        if (!(callback.level_mask & LOG_LEVEL_BIT(header->level))) {
+            continue;
+        }
+        log_event_t event = {
+            .level = header->level,
+            .file = header->file,
+            .line = header->line,
+            .message = header->message,
+            .timestamp = header->timestamp,
+            .thread_id = header->thread_id,
+        };
+        va_copy(event.args, args);
+        callback.func(event, callback.userdata);
+        va_end(event.args);
+    }
+}
+
+// Dispatches an already formatted message as "%s".
+static void _log_dispatch_formatted(const log_event_t* header, ...) {
+    va_list args;
+    va_start(args, header);
+    _log_dispatch(header, args);
+    va_end(args);
+}
+
+static bool _log_wants_text(log_level_t level) {
+    for (uint32_t i = 0; i < g_logger_callback_count; i++) {
+        if (g_logger_callbacks[i].level_mask & LOG_LEVEL_BIT(level)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// -----------------------------------------------------------------------------
+// Deferred formatting
+// -----------------------------------------------------------------------------
+
+#define _LOG_FORMAT_BUFFER_SIZE 4096
+#define _LOG_MAX_SPEC_LENGTH 32
+
+typedef enum _log_arg_type_t {
+    _LOG_ARG_INT,
+    _LOG_ARG_LONG,
+    _LOG_ARG_LONG_LONG,
+    _LOG_ARG_SIZE,
+    _LOG_ARG_INTMAX,
+    _LOG_ARG_PTRDIFF,
+    _LOG_ARG_DOUBLE,
+    _LOG_ARG_LONG_DOUBLE,
+    _LOG_ARG_POINTER,
+    _LOG_ARG_STRING,
+    // String whose length is bounded by the preceding '*' precision.
+    _LOG_ARG_STRING_BOUNDED,
+} _log_arg_type_t;
+
+typedef struct _log_spec_t _log_spec_t;
+struct _log_spec_t {
+    const char* start;
+    size_t length;
+    bool width_star;
+    bool precision_star;
+    _log_arg_type_t type;
+    bool supported;
+};
+
+// Finds the next conversion specification in '*cursor' and moves past it.
+static bool _log_next_spec(const char** cursor, _log_spec_t* spec) {
+    const char* c = *cursor;
+    while (true) {
+        c = strchr(c, '%');
+        if (c == NULL) {
+            return false;
+        }
+        if (c[1] != '%') {
+            break;
+        }
+        c += 2;
+    }
+
+    *spec = (_log_spec_t) {
+        .start = c,
+        .supported = true,
+    };
+    c++;
+    while (*c != '\0' && strchr("-+ #0", *c) != NULL) {
+        c++;
+    }
+    if (*c == '*') {
+        spec->width_star = true;
+        c++;
+    }
+    while (*c >= '0' && *c <= '9') {
+        c++;
+    }
+    bool has_precision = false;
+    if (*c == '.') {
+        has_precision = true;
+        c++;
+        if (*c == '*') {
+            spec->precision_star = true;
+            c++;
+        }
+        while (*c >= '0' && *c <= '9') {
+            c++;
+        }
+    }
+
+    char length = 0;
+    bool doubled = false;
+    if (*c != '\0' && strchr("hljztL", *c) != NULL) {
+        length = *c++;
+        if ((length == 'h' || length == 'l') && *c == length) {
+            doubled = true;
+            c++;
+        }
+    }
+
+    switch (*c) {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            switch (length) {
+                case 'l': spec->type = doubled ? _LOG_ARG_LONG_LONG : _LOG_ARG_LONG; break;
+                case 'j': spec->type = _LOG_ARG_INTMAX; break;
+                case 'z': spec->type = _LOG_ARG_SIZE; break;
+                case 't': spec->type = _LOG_ARG_PTRDIFF; break;
+                case 'L': spec->supported = false; break;
+                default: spec->type = _LOG_ARG_INT; break;
+            }
+            break;
+        case 'c':
+            spec->type = _LOG_ARG_INT;
+            spec->supported = length == 0;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            spec->type = length == 'L' ? _LOG_ARG_LONG_DOUBLE : _LOG_ARG_DOUBLE;
+            break;
+        case 's':
+            spec->type = spec->precision_star ? _LOG_ARG_STRING_BOUNDED : _LOG_ARG_STRING;
+            // Fixed precisions could point at unterminated strings we can't measure safely.
+            spec->supported = length == 0 && (!has_precision || spec->precision_star);
+            break;
+        case 'p':
+            spec->type = _LOG_ARG_POINTER;
+            break;
+        default:
+            spec->supported = false;
+            break;
+    }
+    if (*c != '\0') {
+        c++;
+    }
+    spec->length = c - spec->start;
+    if (spec->length > _LOG_MAX_SPEC_LENGTH) {
+        spec->supported = false;
+    }
+    *cursor = c;
+    return true;
+}
+
+static void _log_site_parse(log_site_t* site) {
+    site->deferrable = site->message != NULL;
+    site->arg_count = 0;
+    if (!site->deferrable) {
+        return;
+    }
+    const char* cursor = site->message;
+    _log_spec_t spec;
+    while (_log_next_spec(&cursor, &spec)) {
+        uint32_t needed = spec.width_star + spec.precision_star + 1;
+        if (!spec.supported || site->arg_count + needed > CORE_LOG_MAX_ARGS) {
+            site->deferrable = false;
+            return;
+        }
+        if (spec.width_star) {
+            site->arg_types[site->arg_count++] = _LOG_ARG_INT;
+        }
+        if (spec.precision_star) {
+            site->arg_types[site->arg_count++] = _LOG_ARG_INT;
+        }
+        site->arg_types[site->arg_count++] = spec.type;
+    }
+}
+
+// Copies the raw arguments described by 'site' into 'out'. Returns the
+// amount of bytes written, or -1 if they don't fit.
+static int32_t _log_encode_args(const log_site_t* site, va_list args, uint8_t* out, size_t capacity) {
+    size_t size = 0;
+    int last_int = -1;
+#define _LOG_ENCODE(T) { \
+        T value = va_arg(args, T); \
+        if (size + sizeof(T) > capacity) { \
+            return -1; \
+        } \
+        memcpy(&out[size], &value, sizeof(T)); \
+        size += sizeof(T); \
+    } break
+    for (uint8_t i = 0; i < site->arg_count; i++) {
+        switch (site->arg_types[i]) {
+            case _LOG_ARG_INT: {
+                int value = va_arg(args, int);
+                if (size + sizeof(int) > capacity) {
+                    return -1;
+                }
+                memcpy(&out[size], &value, sizeof(int));
+                size += sizeof(int);
+                last_int = value;
+            } break;
+            case _LOG_ARG_LONG: _LOG_ENCODE(long);
+            case _LOG_ARG_LONG_LONG: _LOG_ENCODE(long long);
+            case _LOG_ARG_SIZE: _LOG_ENCODE(size_t);
+            case _LOG_ARG_INTMAX: _LOG_ENCODE(intmax_t);
+            case _LOG_ARG_PTRDIFF: _LOG_ENCODE(ptrdiff_t);
+            case _LOG_ARG_DOUBLE: _LOG_ENCODE(double);
+            case _LOG_ARG_LONG_DOUBLE: _LOG_ENCODE(long double);
+            case _LOG_ARG_POINTER: _LOG_ENCODE(void*);
+            case _LOG_ARG_STRING:
+            case _LOG_ARG_STRING_BOUNDED: {
+                const char* value = va_arg(args, const char*);
+                if (value == NULL) {
+                    value = "(null)";
+                }
+                size_t length = site->arg_types[i] == _LOG_ARG_STRING_BOUNDED && last_int >= 0 ?
+                    strnlen(value, (size_t) last_int) : strlen(value);
+                if (length > UINT16_MAX || size + sizeof(uint16_t) + length > capacity) {
+                    return -1;
+                }
+                uint16_t length16 = (uint16_t) length;
+                memcpy(&out[size], &length16, sizeof(uint16_t));
+                memcpy(&out[size + sizeof(uint16_t)], value, length);
+                size += sizeof(uint16_t) + length;
+            } break;
+        }
+    }
+#undef _LOG_ENCODE
+    return (int32_t) size;
+}
+
+static void _log_append(char* out, size_t capacity, size_t* length, const char* data, size_t size) {
+    size_t available = capacity - 1 - *length;
+    if (size > available) {
+        size = available;
+    }
+    memcpy(&out[*length], data, size);
+    *length += size;
+}
+
+static void _log_append_result(size_t capacity, size_t* length, int written) {
+    if (written > 0) {
+        *length += (size_t) written;
+        if (*length > capacity - 1) {
+            *length = capacity - 1;
+        }
+    }
+}
+
+// Formats captured arguments exactly like vsnprintf would have. Always NUL
+// terminates 'out' and returns the length of the text.
+static size_t _log_format_args(const log_site_t* site, const uint8_t* payload, size_t payload_size, char* out, size_t capacity) {
+    size_t length = 0;
+    size_t offset = 0;
+    uint8_t arg = 0;
+    bool valid = true;
+    const char* cursor = site->message;
+
+#define _LOG_DECODE(T, name) \
+    T name; \
+    if (offset + sizeof(T) > payload_size) { \
+        valid = false; \
+        break; \
+    } \
+    memcpy(&name, &payload[offset], sizeof(T)); \
+    offset += sizeof(T)
+#define _LOG_DECODE_FORMAT(T) { \
+        _LOG_DECODE(T, value); \
+        _log_append_result(capacity, &length, snprintf(&out[length], capacity - length, spec_buffer, value)); \
+    } break
+
+    while (valid && length < capacity - 1) {
+        const char* literal = cursor;
+        _log_spec_t spec;
+        bool more = _log_next_spec(&cursor, &spec);
+        const char* literal_end = more ? spec.start : literal + strlen(literal);
+        for (const char* c = literal; c < literal_end; c++) {
+            _log_append(out, capacity, &length, c, 1);
+            if (c[0] == '%' && c[1] == '%') {
+                c++;
+            }
+        }
+        if (!more) {
+            break;
+        }
+
+        // Rebuild the specification with '*' replaced by the captured values.
+        char spec_buffer[_LOG_MAX_SPEC_LENGTH * 2];
+        size_t spec_length = 0;
+        for (size_t i = 0; i < spec.length && valid; i++) {
+            if (spec.start[i] != '*') {
+                spec_buffer[spec_length++] = spec.start[i];
+                continue;
+            }
+            arg++;
+            _LOG_DECODE(int, star);
+            spec_length += snprintf(&spec_buffer[spec_length], sizeof(spec_buffer) - spec_length, "%d", star);
+        }
+        spec_buffer[spec_length] = '\0';
+        if (!valid || arg >= site->arg_count) {
+            break;
+        }
+
+        switch (site->arg_types[arg++]) {
+            case _LOG_ARG_INT: _LOG_DECODE_FORMAT(int);
+            case _LOG_ARG_LONG: _LOG_DECODE_FORMAT(long);
+            case _LOG_ARG_LONG_LONG: _LOG_DECODE_FORMAT(long long);
+            case _LOG_ARG_SIZE: _LOG_DECODE_FORMAT(size_t);
+            case _LOG_ARG_INTMAX: _LOG_DECODE_FORMAT(intmax_t);
+            case _LOG_ARG_PTRDIFF: _LOG_DECODE_FORMAT(ptrdiff_t);
+            case _LOG_ARG_DOUBLE: _LOG_DECODE_FORMAT(double);
+            case _LOG_ARG_LONG_DOUBLE: _LOG_DECODE_FORMAT(long double);
+            case _LOG_ARG_POINTER: _LOG_DECODE_FORMAT(void*);
+            case _LOG_ARG_STRING:
+            case _LOG_ARG_STRING_BOUNDED: {
+                _LOG_DECODE(uint16_t, string_length);
+                if (offset + string_length > payload_size) {
+                    valid = false;
+                    break;
+                }
+                // Print through "%.*s" since the captured string isn't terminated.
+                char* type = &spec_buffer[spec_length - 1];
+                char* precision = strchr(spec_buffer, '.');
+                if (precision != NULL) {
+                    type = precision;
+                }
+                memcpy(type, ".*s", 4);
+                _log_append_result(capacity, &length, snprintf(&out[length], capacity - length, spec_buffer, (int) string_length, (const char*) &payload[offset]));
+                offset += string_length;
+            } break;
+        }
+    }
+#undef _LOG_DECODE_FORMAT
+#undef _LOG_DECODE
+
+    out[length] = '\0';
+    return length;
+}
+
+// -----------------------------------------------------------------------------
+// Binary log
+// -----------------------------------------------------------------------------
+
+#define _LOG_BINARY_MAGIC "CORELOG1"
+#define _LOG_BINARY_MAGIC_SIZE 8
+
+typedef enum _log_binary_record_type_t {
+    _LOG_BINARY_SITE = 1,
+    _LOG_BINARY_EVENT = 2,
+    _LOG_BINARY_TEXT = 3,
+} _log_binary_record_type_t;
+
+// SITE:  type u8, id u32, level u8, line i32, file length u16, format length u16, file, format
+// EVENT: type u8, id u32, timestamp u64, thread id u64, size u16, arguments
+// TEXT:  type u8, id u32, level u8, line i32, timestamp u64, thread id u64, file length u16, text length u16, file, text
+// Strings include their NUL terminator. TEXT records with a non-zero id take
+// their file from the site and store an empty one.
+#define _LOG_BINARY_EVENT_HEADER_SIZE (1 + 4 + 8 + 8 + 2)
+
+static atomic_flag g_logger_site_lock = ATOMIC_FLAG_INIT;
+static log_site_t* g_logger_sites = NULL;
+static uint32_t g_logger_site_count = 0;
+
+static uint8_t* _log_put(uint8_t* cursor, const void* data, size_t size) {
+    memcpy(cursor, data, size);
+    return cursor + size;
+}
+
+static uint16_t _log_string_size(const char* string) {
+    size_t size = strlen(string) + 1;
+    return size > UINT16_MAX ? UINT16_MAX : (uint16_t) size;
+}
+
+static void _logger_binary_write_site(const log_site_t* site) {
+    uint32_t id = atomic_load_explicit(&site->id, memory_order_relaxed);
+    uint8_t level = (uint8_t) site->level;
+    uint16_t file_size = _log_string_size(site->file);
+    const char* format = site->message != NULL ? site->message : "";
+    uint16_t format_size = _log_string_size(format);
+
+    arena_scope_t scratch = scratch_begin(NULL, 0);
+    uint8_t* record = arena_push(scratch.arena, 1 + 4 + 1 + 4 + 2 + 2 + file_size + format_size);
+    uint8_t* cursor = record;
+    *cursor++ = _LOG_BINARY_SITE;
+    cursor = _log_put(cursor, &id, sizeof(id));
+    cursor = _log_put(cursor, &level, sizeof(level));
+    cursor = _log_put(cursor, &site->line, sizeof(site->line));
+    cursor = _log_put(cursor, &file_size, sizeof(file_size));
+    cursor = _log_put(cursor, &format_size, sizeof(format_size));
+    cursor = _log_put(cursor, site->file, file_size - 1);
+    *cursor++ = '\0';
+    cursor = _log_put(cursor, format, format_size - 1);
+    *cursor++ = '\0';
+    fwrite(record, 1, cursor - record, g_logger_binary_file);
+    scratch_end(&scratch);
+}
+
+static void _logger_binary_write_event(const log_event_t* header, uint32_t id, const uint8_t* payload, uint16_t size) {
+    uint8_t record[_LOG_BINARY_EVENT_HEADER_SIZE + CORE_LOG_ASYNC_MESSAGE_SIZE];
+    uint8_t* cursor = record;
+    *cursor++ = _LOG_BINARY_EVENT;
+    cursor = _log_put(cursor, &id, sizeof(id));
+    cursor = _log_put(cursor, &header->timestamp, sizeof(header->timestamp));
+    cursor = _log_put(cursor, &header->thread_id, sizeof(header->thread_id));
+    cursor = _log_put(cursor, &size, sizeof(size));
+    cursor = _log_put(cursor, payload, size);
+    fwrite(record, 1, cursor - record, g_logger_binary_file);
+}
+
+static void _logger_binary_write_text(const log_event_t* header, uint32_t id, const char* text) {
+    uint8_t level = (uint8_t) header->level;
+    uint16_t file_size = id == 0 ? _log_string_size(header->file) : 1;
+    uint16_t text_size = _log_string_size(text);
+
+    arena_scope_t scratch = scratch_begin(NULL, 0);
+    uint8_t* record = arena_push(scratch.arena, 1 + 4 + 1 + 4 + 8 + 8 + 2 + 2 + file_size + text_size);
+    uint8_t* cursor = record;
+    *cursor++ = _LOG_BINARY_TEXT;
+    cursor = _log_put(cursor, &id, sizeof(id));
+    cursor = _log_put(cursor, &level, sizeof(level));
+    cursor = _log_put(cursor, &header->line, sizeof(header->line));
+    cursor = _log_put(cursor, &header->timestamp, sizeof(header->timestamp));
+    cursor = _log_put(cursor, &header->thread_id, sizeof(header->thread_id));
+    cursor = _log_put(cursor, &file_size, sizeof(file_size));
+    cursor = _log_put(cursor, &text_size, sizeof(text_size));
+    cursor = _log_put(cursor, header->file, file_size - 1);
+    *cursor++ = '\0';
+    cursor = _log_put(cursor, text, text_size - 1);
+    *cursor++ = '\0';
+    fwrite(record, 1, cursor - record, g_logger_binary_file);
+    scratch_end(&scratch);
+}
+
+static void _log_site_register(log_site_t* site) {
+    while (atomic_flag_test_and_set_explicit(&g_logger_site_lock, memory_order_acquire)) {
+        _os_yield();
+    }
+    if (atomic_load_explicit(&site->id, memory_order_relaxed) == 0) {
+        _log_site_parse(site);
+        site->next = g_logger_sites;
+        g_logger_sites = site;
+        atomic_store_explicit(&site->id, ++g_logger_site_count, memory_order_release);
+        if (g_logger_binary_file != NULL) {
+            _logger_binary_write_site(site);
+        }
+    }
+    atomic_flag_clear_explicit(&g_logger_site_lock, memory_order_release);
+}
+
+typedef struct _logger_record_t _logger_record_t;
+struct _logger_record_t {
+    _Atomic size_t sequence;
+    log_level_t level;
+    const char* file;
+    int32_t line;
+    uint64_t timestamp;
+    uint64_t thread_id;
+    const log_site_t* site;
+    // Set when 'message' holds the site's captured arguments rather than text.
+    bool deferred;
+    uint16_t payload_size;
+    char message[CORE_LOG_ASYNC_MESSAGE_SIZE];
+};
+
+// Multi-producer single-consumer ring buffer. Every record carries a sequence
+// number telling producers and the consumer whose turn it is.
+typedef struct _logger_async_t _logger_async_t;
+struct _logger_async_t {
+    allocator_t allocator;
+    _logger_record_t* records;
+    size_t capacity;
+    logger_overflow_policy_t policy;
+    _os_thread_t thread;
+    atomic_bool running;
+    _Atomic size_t enqueue_position;
+    _Atomic size_t dequeue_position;
+    _Atomic uint64_t dropped;
+    _Atomic uint64_t flush_requested;
+    _Atomic uint64_t flush_completed;
+};
+
+static _logger_async_t g_logger_async = {0};
+static core_thread_local bool t_logger_is_consumer = false;
+
+static bool _logger_async_dispatch_one(void) {
+    _logger_async_t* async = &g_logger_async;
+    size_t position = atomic_load_explicit(&async->dequeue_position, memory_order_relaxed);
+    _logger_record_t* record = &async->records[position & (async->capacity - 1)];
+    if (atomic_load_explicit(&record->sequence, memory_order_acquire) != position + 1) {
+        return false;
+    }
+
+    log_event_t header = {
+        .level = record->level,
+        .file = record->file,
+        .line = record->line,
+        .message = "%s",
+        .timestamp = record->timestamp,
+        .thread_id = record->thread_id,
+    };
+    uint32_t id = record->site == NULL ? 0 : atomic_load_explicit(&record->site->id, memory_order_relaxed);
+    _logger_callback_lock();
+    if (record->deferred) {
+        if (g_logger_binary_file != NULL) {
+            _logger_binary_write_event(&header, id, (const uint8_t*) record->message, record->payload_size);
+        }
+        if (_log_wants_text(header.level)) {
+            char text[_LOG_FORMAT_BUFFER_SIZE];
+            _log_format_args(record->site, (const uint8_t*) record->message, record->payload_size, text, sizeof(text));
+            _log_dispatch_formatted(&header, text);
+        }
+    } else {
+        if (g_logger_binary_file != NULL) {
+            _logger_binary_write_text(&header, id, record->message);
+        }
+        _log_dispatch_formatted(&header, record->message);
+    }
+    _logger_callback_unlock();
+
+    atomic_store_explicit(&record->sequence, position + async->capacity, memory_order_release);
+    atomic_store_explicit(&async->dequeue_position, position + 1, memory_order_release);
+    return true;
+}
+
+static void _logger_async_thread(void* data) {
+    unused(data);
+    t_logger_is_consumer = true;
+    _logger_async_t* async = &g_logger_async;
+    uint32_t idle = 0;
+    while (true) {
+        if (_logger_async_dispatch_one()) {
+            idle = 0;
+            continue;
+        }
+        uint64_t requested = atomic_load_explicit(&async->flush_requested, memory_order_acquire);
+        if (requested != atomic_load_explicit(&async->flush_completed, memory_order_relaxed)) {
+            _logger_run_flush_callbacks();
+            atomic_store_explicit(&async->flush_completed, requested, memory_order_release);
+            continue;
+        }
+        if (!atomic_load_explicit(&async->running, memory_order_acquire)) {
+            // Drain whatever was logged before stopping.
+            while (_logger_async_dispatch_one());
+            _logger_run_flush_callbacks();
+            break;
+        }
+        if (idle < 64) {
+            idle++;
+            _os_yield();
+        } else {
+            // Hand buffered output to the sinks before going to sleep.
+            if (idle == 64) {
+                idle++;
+                _logger_run_flush_callbacks();
+            }
+            _os_sleep_ms(1);
+        }
+    }
+}
+
+bool logger_async_start(allocator_t allocator, size_t capacity, logger_overflow_policy_t policy) {
+    core_assert_msg(g_logger_async.records == NULL, "Asynchronous logging is already running");
+    core_assert_msg(_is_power_of_two(capacity) && capacity > 0, "Capacity must be a power of two");
+    _logger_async_t* async = &g_logger_async;
+    async->records = core_alloc(allocator, sizeof(_logger_record_t) * capacity);
+    if (async->records == NULL) {
+        return false;
+    }
+    async->allocator = allocator;
+    async->capacity = capacity;
+    async->policy = policy;
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&async->records[i].sequence, i);
+    }
+    atomic_store(&async->enqueue_position, 0);
+    atomic_store(&async->dequeue_position, 0);
+    atomic_store(&async->dropped, 0);
+    atomic_store(&async->flush_requested, 0);
+    atomic_store(&async->flush_completed, 0);
+    atomic_store(&async->running, true);
+    if (!_os_thread_start(&async->thread, _logger_async_thread, NULL)) {
+        core_free(allocator, async->records, sizeof(_logger_record_t) * capacity);
+        async->records = NULL;
+        return false;
+    }
+    return true;
+}
+
+void logger_async_stop(void) {
+    _logger_async_t* async = &g_logger_async;
+    if (async->records == NULL) {
+        return;
+    }
+    atomic_store_explicit(&async->running, false, memory_order_release);
+    _os_thread_join(&async->thread);
+    core_free(async->allocator, async->records, sizeof(_logger_record_t) * async->capacity);
+    async->records = NULL;
+}
+
+void logger_flush(void) {
+    _logger_async_t* async = &g_logger_async;
+    if (async->records == NULL || t_logger_is_consumer) {
+        _logger_run_flush_callbacks();
+        return;
+    }
+    size_t target = atomic_load_explicit(&async->enqueue_position, memory_order_acquire);
+    while (atomic_load_explicit(&async->dequeue_position, memory_order_acquire) < target) {
+        _os_yield();
+    }
+    // The consumer runs the flush callbacks so they never race with dispatch.
+    uint64_t ticket = atomic_fetch_add_explicit(&async->flush_requested, 1, memory_order_acq_rel) + 1;
+    while (atomic_load_explicit(&async->flush_completed, memory_order_acquire) < ticket) {
+        _os_yield();
+    }
+}
+
+uint64_t logger_dropped_count(void) {
+    return atomic_load_explicit(&g_logger_async.dropped, memory_order_relaxed);
+}
+
+static void _logger_async_enqueue(const log_event_t* header, const log_site_t* site, va_list args) {
+    _logger_async_t* async = &g_logger_async;
+    size_t position = atomic_load_explicit(&async->enqueue_position, memory_order_relaxed);
+    _logger_record_t* record;
+    while (true) {
+        record = &async->records[position & (async->capacity - 1)];
+        size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) position;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&async->enqueue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            if (async->policy == LOGGER_OVERFLOW_DROP) {
+                atomic_fetch_add_explicit(&async->dropped, 1, memory_order_relaxed);
+                return;
+            }
+            _os_yield();
+            position = atomic_load_explicit(&async->enqueue_position, memory_order_relaxed);
+        } else {
+            position = atomic_load_explicit(&async->enqueue_position, memory_order_relaxed);
+        }
+    }
+
+    record->level = header->level;
+    record->file = header->file;
+    record->line = header->line;
+    record->timestamp = header->timestamp;
+    record->thread_id = header->thread_id;
+    record->site = site;
+    record->deferred = false;
+    if (site != NULL && site->deferrable) {
+        va_list copy;
+        va_copy(copy, args);
+        int32_t size = _log_encode_args(site, copy, (uint8_t*) record->message, CORE_LOG_ASYNC_MESSAGE_SIZE);
+        va_end(copy);
+        record->deferred = size >= 0;
+        record->payload_size = size >= 0 ? (uint16_t) size : 0;
+    }
+    if (!record->deferred) {
+        vsnprintf(record->message, CORE_LOG_ASYNC_MESSAGE_SIZE, header->message, args);
+    }
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+}
+
+static void _log_log_common(const log_event_t* header, log_site_t* site, va_list args) {
+    // Events logged by callbacks themselves are dispatched directly.
+    if (g_logger_async.records != NULL && !t_logger_is_consumer) {
+        _logger_async_enqueue(header, site, args);
+        if (header->level == LOG_LEVEL_FATAL) {
+            logger_flush();
+        }
+        return;
+    }
+
+    if (g_logger_binary_file != NULL) {
+        uint32_t id = site == NULL ? 0 : atomic_load_explicit(&site->id, memory_order_relaxed);
+        int32_t size = -1;
+        uint8_t payload[CORE_LOG_ASYNC_MESSAGE_SIZE];
+        if (site != NULL && site->deferrable) {
+            va_list copy;
+            va_copy(copy, args);
+            size = _log_encode_args(site, copy, payload, sizeof(payload));
+            va_end(copy);
+        }
+        if (size >= 0) {
+            _logger_binary_write_event(header, id, payload, (uint16_t) size);
+        } else {
+            char text[_LOG_FORMAT_BUFFER_SIZE];
+            va_list copy;
+            va_copy(copy, args);
+            vsnprintf(text, sizeof(text), header->message, copy);
+            va_end(copy);
+            _logger_binary_write_text(header, id, text);
+        }
+    }
+    _log_dispatch(header, args);
+}
+
+void _log_log(log_level_t level, const char* file, int32_t line, const char* message, ...) {
+    log_event_t header = {
+        .level = level,
+        .file = file,
+        .line = line,
+        .message = message,
+        .timestamp = _os_wall_clock_ns(),
+        .thread_id = _os_thread_id(),
+    };
+    va_list args;
+    va_start(args, message);
+    _log_log_common(&header, NULL, args);
+    va_end(args);
+}
+
+void _log_log_site(log_site_t* site, const char* message, ...) {
+    if (atomic_load_explicit(&site->id, memory_order_acquire) == 0) {
+        _log_site_register(site);
+    }
+    log_event_t header = {
+        .level = site->level,
+        .file = site->file,
+        .line = site->line,
+        .message = message,
+        .timestamp = _os_wall_clock_ns(),
+        .thread_id = _os_thread_id(),
+    };
+    va_list args;
+    va_start(args, message);
+    _log_log_common(&header, site, args);
+    va_end(args);
+}
+
+bool _log_limit_every_n(_log_limit_t* limit, uint64_t n, uint64_t* suppressed) {
+    uint64_t count = atomic_fetch_add_explicit(&limit->count, 1, memory_order_relaxed);
+    if (n <= 1) {
+        return true;
+    }
+    if (count % n != 0) {
+        return false;
+    }
+    *suppressed = count == 0 ? 0 : n - 1;
+    return true;
+}
+
+bool _log_limit_once(_log_limit_t* limit) {
+    return atomic_fetch_add_explicit(&limit->count, 1, memory_order_relaxed) == 0;
+}
+
+#define _LOG_RATE_WINDOW_NS 1000000000ull
+
+// The clock is only read by the first event of a window, which starts it, and
+// by events over budget, which check whether it has ended.
+bool _log_limit_rate(_log_limit_t* limit, uint32_t max_per_second, uint64_t* suppressed) {
+    uint32_t count = atomic_fetch_add_explicit(&limit->window_count, 1, memory_order_relaxed);
+    if (count >= max_per_second) {
+        uint64_t now = _os_monotonic_ns();
+        uint64_t start = atomic_load_explicit(&limit->window_start, memory_order_relaxed);
+        if (max_per_second == 0 || now - start < _LOG_RATE_WINDOW_NS ||
+                !atomic_compare_exchange_strong_explicit(&limit->window_start, &start, now, memory_order_relaxed, memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&limit->suppressed, 1, memory_order_relaxed);
+            return false;
+        }
+        atomic_store_explicit(&limit->window_count, 1, memory_order_relaxed);
+    } else if (count == 0) {
+        atomic_store_explicit(&limit->window_start, _os_monotonic_ns(), memory_order_relaxed);
+    }
+    *suppressed = atomic_exchange_explicit(&limit->suppressed, 0, memory_order_relaxed);
+    return true;
+}
+
+bool logger_binary_open(const char* path) {
+    core_assert_msg(g_logger_binary_file == NULL, "A binary log is already open");
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, 64 * 1024);
+    fwrite(_LOG_BINARY_MAGIC, 1, _LOG_BINARY_MAGIC_SIZE, file);
+
+    logger_flush();
+    while (atomic_flag_test_and_set_explicit(&g_logger_site_lock, memory_order_acquire)) {
+        _os_yield();
+    }
+    g_logger_binary_file = file;
+    for (log_site_t* site = g_logger_sites; site != NULL; site = site->next) {
+        _logger_binary_write_site(site);
+    }
+    atomic_flag_clear_explicit(&g_logger_site_lock, memory_order_release);
+    _logger_update_level_mask();
+    return true;
+}
+
+void logger_binary_close(void) {
+    if (g_logger_binary_file == NULL) {
+        return;
+    }
+    logger_flush();
+    fclose(g_logger_binary_file);
+    g_logger_binary_file = NULL;
+    _logger_update_level_mask();
+}
+
+// -----------------------------------------------------------------------------
+// Sinks
+// -----------------------------------------------------------------------------
+
+static const char* g_log_level_names[_LOG_LEVEL_COUNT] = {
+    "FATAL",
+    "ERROR",
+    "WARN ",
+    "INFO ",
+    "DEBUG",
+    "TRACE",
+};
+
+static const char* g_log_level_colours[_LOG_LEVEL_COUNT] = {
+    "\x1b[1;35m",
+    "\x1b[1;31m",
+    "\x1b[33m",
+    "\x1b[32m",
+    "\x1b[36m",
+    "\x1b[90m",
+};
+
+// Formats a Unix timestamp as UTC ISO 8601 without relying on the CRT's time zone handling.
+static size_t _log_format_timestamp(char* out, size_t capacity, uint64_t timestamp) {
+    uint64_t seconds = timestamp / 1000000000ull;
+    uint32_t millis = (uint32_t) (timestamp / 1000000ull % 1000);
+    int64_t days = (int64_t) (seconds / 86400);
+    uint32_t day_seconds = (uint32_t) (seconds % 86400);
+
+    // Civil from days, see http://howardhinnant.github.io/date_algorithms.html
+    days += 719468;
+    int64_t era = days / 146097;
+    uint32_t day_of_era = (uint32_t) (days - era * 146097);
+    uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    uint32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    uint32_t mp = (5 * day_of_year + 2) / 153;
+    uint32_t day = day_of_year - (153 * mp + 2) / 5 + 1;
+    uint32_t month = mp < 10 ? mp + 3 : mp - 9;
+    int64_t year = (int64_t) year_of_era + era * 400 + (month <= 2);
+
+    int written = snprintf(out, capacity, "%04lld-%02u-%02uT%02u:%02u:%02u.%03uZ",
+            (long long) year, month, day, day_seconds / 3600, day_seconds / 60 % 60, day_seconds % 60, millis);
+    return written < 0 ? 0 : (size_t) written;
+}
+
+// Returns the length of the formatted line or 'capacity' if it didn't fit.
+static size_t _log_sink_format(const log_sink_t* sink, char* out, size_t capacity, const log_event_t* event, va_list args) {
+    char timestamp[48];
+    _log_format_timestamp(timestamp, sizeof(timestamp), event->timestamp);
+    int prefix;
+    if (sink->desc.colour) {
+        prefix = snprintf(out, capacity, "%s %s%s\x1b[0m %s:%d: ", timestamp, g_log_level_colours[event->level], g_log_level_names[event->level], event->file, event->line);
+    } else {
+        prefix = snprintf(out, capacity, "%s %s %s:%d: ", timestamp, g_log_level_names[event->level], event->file, event->line);
+    }
+    if (prefix < 0 || (size_t) prefix >= capacity) {
+        return capacity;
+    }
+    int message = vsnprintf(&out[prefix], capacity - prefix, event->message, args);
+    if (message < 0 || (size_t) (prefix + message) + 1 >= capacity) {
+        return capacity;
+    }
+    size_t length = (size_t) (prefix + message);
+    out[length++] = '\n';
+    return length;
+}
+
+static void _log_sink_lock(log_sink_t* sink) {
+    while (atomic_flag_test_and_set_explicit(&sink->lock, memory_order_acquire)) {
+        _os_yield();
+    }
+}
+
+static void _log_sink_unlock(log_sink_t* sink) {
+    atomic_flag_clear_explicit(&sink->lock, memory_order_release);
+}
+
+static void _log_sink_rotate(log_sink_t* sink) {
+    fclose(sink->file);
+    arena_scope_t scratch = scratch_begin(&sink->arena, 1);
+    size_t size = strlen(sink->path) + 16;
+    char* from = arena_push(scratch.arena, size);
+    char* to = arena_push(scratch.arena, size);
+    for (uint32_t i = sink->desc.max_files; i > 1; i--) {
+        snprintf(from, size, "%s.%u", sink->path, i - 1);
+        snprintf(to, size, "%s.%u", sink->path, i);
+        remove(to);
+        rename(from, to);
+    }
+    if (sink->desc.max_files > 0) {
+        snprintf(to, size, "%s.1", sink->path);
+        remove(to);
+        rename(sink->path, to);
+    }
+    scratch_end(&scratch);
+
+    sink->file = fopen(sink->path, "wb");
+    if (sink->file != NULL) {
+        setvbuf(sink->file, NULL, _IONBF, 0);
+    }
+    sink->file_size = 0;
+}
+
+// Writes the whole buffer with a single call. Must hold the lock.
+static void _log_sink_write(log_sink_t* sink) {
+    sink->last_flush = _os_monotonic_ns();
+    if (sink->length == 0) {
+        return;
+    }
+    if (!sink->console && sink->desc.max_file_size > 0 && sink->file_size > 0 &&
+            sink->file_size + sink->length > sink->desc.max_file_size) {
+        _log_sink_rotate(sink);
+    }
+    if (sink->file != NULL) {
+        fwrite(sink->buffer, 1, sink->length, sink->file);
+    }
+    sink->file_size += sink->length;
+    sink->length = 0;
+}
+
+static log_sink_t* _log_sink_create(allocator_t allocator, const char* path, const log_sink_desc_t* desc) {
+    log_sink_desc_t resolved = desc == NULL ? (log_sink_desc_t) {0} : *desc;
+    if (resolved.buffer_size == 0) {
+        resolved.buffer_size = LOG_SINK_DEFAULT_BUFFER_SIZE;
+    }
+    if (resolved.flush_interval_ms == 0) {
+        resolved.flush_interval_ms = LOG_SINK_DEFAULT_FLUSH_INTERVAL_MS;
+    }
+    size_t path_size = path == NULL ? 0 : strlen(path) + 1;
+    arena_t* arena = arena_create(allocator, sizeof(arena_t) + sizeof(log_sink_t) + resolved.buffer_size + path_size + 64);
+    if (arena == NULL) {
+        return NULL;
+    }
+    log_sink_t* sink = arena_push(arena, sizeof(log_sink_t));
+    *sink = (log_sink_t) {
+        .arena = arena,
+        .desc = resolved,
+        .console = path == NULL,
+        .lock = ATOMIC_FLAG_INIT,
+        .buffer = arena_push(arena, resolved.buffer_size),
+        .last_flush = _os_monotonic_ns(),
+    };
+    if (path != NULL) {
+        char* path_copy = arena_push(arena, path_size);
+        memcpy(path_copy, path, path_size);
+        sink->path = path_copy;
+    }
+    return sink;
+}
+
+log_sink_t* log_sink_create_file(allocator_t allocator, const char* path, const log_sink_desc_t* desc) {
+    FILE* file = fopen(path, "ab");
+    if (file == NULL) {
+        return NULL;
+    }
+    // The sink does its own batching.
+    setvbuf(file, NULL, _IONBF, 0);
+    log_sink_t* sink = _log_sink_create(allocator, path, desc);
+    if (sink == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    sink->file = file;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    sink->file_size = size < 0 ? 0 : (size_t) size;
+    return sink;
+}
+
+log_sink_t* log_sink_create_console(allocator_t allocator, const log_sink_desc_t* desc) {
+    log_sink_t* sink = _log_sink_create(allocator, NULL, desc);
+    if (sink == NULL) {
+        return NULL;
+    }
+    sink->file = stderr;
+    return sink;
+}
+
+void log_sink_destroy(log_sink_t** sink) {
+    logger_flush();
+    logger_unregister(*sink);
+    _log_sink_lock(*sink);
+    _log_sink_write(*sink);
+    if (!(*sink)->console && (*sink)->file != NULL) {
+        fclose((*sink)->file);
+    }
+    arena_t* arena = (*sink)->arena;
+    arena_destroy(&arena);
+    *sink = NULL;
+}
+
+void log_sink_register(log_sink_t* sink, uint32_t level_mask) {
+    logger_register_callback_mask(log_sink_callback, sink, level_mask);
+    logger_register_flush_callback(log_sink_flush, sink);
+}
+
+void log_sink_callback(log_event_t event, void* userdata) {
+    log_sink_t* sink = userdata;
+    _log_sink_lock(sink);
+
+    va_list args;
+    va_copy(args, event.args);
+    size_t available = sink->desc.buffer_size - sink->length;
+    size_t length = _log_sink_format(sink, &sink->buffer[sink->length], available, &event, args);
+    va_end(args);
+    if (length >= available && sink->length > 0) {
+        _log_sink_write(sink);
+        available = sink->desc.buffer_size;
+        va_copy(args, event.args);
+        length = _log_sink_format(sink, sink->buffer, available, &event, args);
+        va_end(args);
+    }
+    if (length >= available) {
+        // Longer than the whole buffer, keep what fits.
+        length = available;
+        sink->buffer[sink->length + length - 1] = '\n';
+    }
+    sink->length += length;
+
+    bool flush = event.level <= sink->desc.flush_level ||
+        (sink->console && g_logger_async.records == NULL) ||
+        _os_monotonic_ns() - sink->last_flush >= (uint64_t) sink->desc.flush_interval_ms * 1000000ull;
+    if (flush) {
+        _log_sink_write(sink);
+    }
+    _log_sink_unlock(sink);
+}
+
+void log_sink_flush(void* userdata) {
+    log_sink_t* sink = userdata;
+    _log_sink_lock(sink);
+    _log_sink_write(sink);
+    _log_sink_unlock(sink);
+}
+
+typedef struct _log_reader_t _log_reader_t;
+struct _log_reader_t {
+    const uint8_t* data;
+    size_t size;
+    size_t offset;
+    bool valid;
+};
+
+static void _log_read(_log_reader_t* reader, void* out, size_t size) {
+    if (!reader->valid || reader->offset + size > reader->size) {
+        reader->valid = false;
+        memset(out, 0, size);
+        return;
+    }
+    memcpy(out, &reader->data[reader->offset], size);
+    reader->offset += size;
+}
+
+static const char* _log_read_string(_log_reader_t* reader, uint16_t size) {
+    if (!reader->valid || size == 0 || reader->offset + size > reader->size || reader->data[reader->offset + size - 1] != '\0') {
+        reader->valid = false;
+        return "";
+    }
+    const char* string = (const char*) &reader->data[reader->offset];
+    reader->offset += size;
+    return string;
+}
+
+typedef struct _log_binary_record_t _log_binary_record_t;
+struct _log_binary_record_t {
+    uint8_t type;
+    uint32_t id;
+    uint8_t level;
+    int32_t line;
+    uint64_t timestamp;
+    uint64_t thread_id;
+    const char* file;
+    const char* text;
+    const uint8_t* payload;
+    uint16_t payload_size;
+};
+
+static bool _log_binary_read_record(_log_reader_t* reader, _log_binary_record_t* record) {
+    *record = (_log_binary_record_t) {0};
+    _log_read(reader, &record->type, sizeof(record->type));
+    _log_read(reader, &record->id, sizeof(record->id));
+    uint16_t file_size = 0;
+    uint16_t text_size = 0;
+    switch (record->type) {
+        case _LOG_BINARY_SITE:
+            _log_read(reader, &record->level, sizeof(record->level));
+            _log_read(reader, &record->line, sizeof(record->line));
+            _log_read(reader, &file_size, sizeof(file_size));
+            _log_read(reader, &text_size, sizeof(text_size));
+            record->file = _log_read_string(reader, file_size);
+            record->text = _log_read_string(reader, text_size);
+            break;
+        case _LOG_BINARY_EVENT:
+            _log_read(reader, &record->timestamp, sizeof(record->timestamp));
+            _log_read(reader, &record->thread_id, sizeof(record->thread_id));
+            _log_read(reader, &record->payload_size, sizeof(record->payload_size));
+            if (reader->valid && reader->offset + record->payload_size <= reader->size) {
+                record->payload = &reader->data[reader->offset];
+                reader->offset += record->payload_size;
+            } else {
+                reader->valid = false;
+            }
+            break;
+        case _LOG_BINARY_TEXT:
+            _log_read(reader, &record->level, sizeof(record->level));
+            _log_read(reader, &record->line, sizeof(record->line));
+            _log_read(reader, &record->timestamp, sizeof(record->timestamp));
+            _log_read(reader, &record->thread_id, sizeof(record->thread_id));
+            _log_read(reader, &file_size, sizeof(file_size));
+            _log_read(reader, &text_size, sizeof(text_size));
+            record->file = _log_read_string(reader, file_size);
+            record->text = _log_read_string(reader, text_size);
+            break;
+        default:
+            reader->valid = false;
+            break;
+    }
+    return reader->valid;
+}
+
+static void _log_call_formatted(logger_callback_func_t func, void* userdata, const log_event_t* header, ...) {
+    log_event_t event = *header;
+    va_start(event.args, header);
+    func(event, userdata);
+    va_end(event.args);
+}
+
+bool log_binary_decode(allocator_t allocator, const char* path, logger_callback_func_t func, void* userdata) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (file_size < _LOG_BINARY_MAGIC_SIZE) {
+        fclose(file);
+        return false;
+    }
+    uint8_t* data = core_alloc(allocator, (size_t) file_size);
+    if (data == NULL) {
+        fclose(file);
+        return false;
+    }
+    size_t size = fread(data, 1, (size_t) file_size, file);
+    fclose(file);
+    if (size != (size_t) file_size || memcmp(data, _LOG_BINARY_MAGIC, _LOG_BINARY_MAGIC_SIZE) != 0) {
+        core_free(allocator, data, (size_t) file_size);
+        return false;
+    }
+
+    // Sites may be written after their first events, so collect them all up
+    // front. Ids are handed out from 1 and every site is written once, so an
+    // id past the number of site records means the file is corrupt.
+    _log_reader_t reader = { .data = data, .size = size, .offset = _LOG_BINARY_MAGIC_SIZE, .valid = true };
+    _log_binary_record_t record;
+    size_t site_records = 0;
+    uint32_t max_id = 0;
+    while (reader.offset < reader.size && _log_binary_read_record(&reader, &record)) {
+        if (record.type == _LOG_BINARY_SITE) {
+            site_records++;
+            max_id = record.id > max_id ? record.id : max_id;
+        }
+    }
+    size_t site_count = (size_t) max_id + 1;
+    log_site_t* sites = NULL;
+    if (max_id <= site_records && site_count <= SIZE_MAX / sizeof(log_site_t)) {
+        sites = core_alloc(allocator, sizeof(log_site_t) * site_count);
+    }
+    if (sites == NULL) {
+        core_free(allocator, data, (size_t) file_size);
+        return false;
+    }
+    memset(sites, 0, sizeof(log_site_t) * site_count);
+    reader = (_log_reader_t) { .data = data, .size = size, .offset = _LOG_BINARY_MAGIC_SIZE, .valid = true };
+    while (reader.offset < reader.size && _log_binary_read_record(&reader, &record)) {
+        if (record.type == _LOG_BINARY_SITE && record.id < site_count) {
+            log_site_t* site = &sites[record.id];
+            site->level = (log_level_t) record.level;
+            site->file = record.file;
+            site->line = record.line;
+            site->message = record.text;
+            atomic_store_explicit(&site->id, record.id, memory_order_relaxed);
+            _log_site_parse(site);
+        }
+    }
+
+    reader = (_log_reader_t) { .data = data, .size = size, .offset = _LOG_BINARY_MAGIC_SIZE, .valid = true };
+    while (reader.offset < reader.size && _log_binary_read_record(&reader, &record)) {
+        if (record.type == _LOG_BINARY_SITE || record.id >= site_count) {
+            continue;
+        }
+        const log_site_t* site = &sites[record.id];
+        log_event_t header = {
+            .level = record.type == _LOG_BINARY_TEXT ? (log_level_t) record.level : site->level,
+            .file = record.id == 0 ? record.file : site->file,
+            .line = record.type == _LOG_BINARY_TEXT ? record.line : site->line,
+            .message = "%s",
+            .timestamp = record.timestamp,
+            .thread_id = record.thread_id,
+        };
+        if (record.type == _LOG_BINARY_TEXT) {
+            _log_call_formatted(func, userdata, &header, record.text);
+        } else if (site->message != NULL) {
+            char text[_LOG_FORMAT_BUFFER_SIZE];
+            _log_format_args(site, record.payload, record.payload_size, text, sizeof(text));
+            _log_call_formatted(func, userdata, &header, text);
+        }
+    }
+    bool valid = reader.valid;
+
+    core_free(allocator, sites, sizeof(log_site_t) * site_count);
+    core_free(allocator, data, (size_t) file_size);
+    return valid;
+}
+
+// =============================================================================
+// ARENA ALLOCATOR
+// =============================================================================
+
+#if defined(CORE_ARENA_STATS)
+
+static arena_t* g_arena_registry = NULL;
+static atomic_flag g_arena_registry_lock = ATOMIC_FLAG_INIT;
+
+static void _arena_registry_lock(void) {
+    while (atomic_flag_test_and_set_explicit(&g_arena_registry_lock, memory_order_acquire)) {
+        _os_yield();
+    }
+}
+
+static void _arena_registry_unlock(void) {
+    atomic_flag_clear_explicit(&g_arena_registry_lock, memory_order_release);
+}
+
+static void _arena_stats_register(arena_t* arena) {
+    _arena_registry_lock();
+    arena->_registry_next = g_arena_registry;
+    if (g_arena_registry != NULL) {
+        g_arena_registry->_registry_prev = arena;
+    }
+    g_arena_registry = arena;
+    _arena_registry_unlock();
+}
+
+static void _arena_stats_unregister(arena_t* arena) {
+    _arena_registry_lock();
+    if (arena->_registry_prev != NULL) {
+        arena->_registry_prev->_registry_next = arena->_registry_next;
+    } else {
+        g_arena_registry = arena->_registry_next;
+    }
+    if (arena->_registry_next != NULL) {
+        arena->_registry_next->_registry_prev = arena->_registry_prev;
+    }
+    _arena_registry_unlock();
+}
+
+static void _arena_stats_update_usage(arena_t* arena) {
+    arena->stats.used_bytes = arena->stats._block_base + arena->position;
+    if (arena->stats.used_bytes > arena->stats.high_water_mark) {
+        arena->stats.high_water_mark = arena->stats.used_bytes;
+    }
+}
+
+void arena_set_name(arena_t* arena, const char* name) {
+    arena->name = name;
+}
+
+arena_stats_t arena_stats(const arena_t* arena) {
+    return arena->stats;
+}
+
+void arena_registry_visit(arena_visit_func_t func, void* userdata) {
+    _arena_registry_lock();
+    for (arena_t* arena = g_arena_registry; arena != NULL; arena = arena->_registry_next) {
+        func(arena, userdata);
+    }
+    _arena_registry_unlock();
+}
+
+#define _arena_stats(statement) statement
+
+#else
+
+#define _arena_stats(statement)
+
+#endif
+
+arena_t* arena_create(allocator_t allocator, size_t capacity) {
+    arena_t* arena = core_alloc(allocator, capacity);
+    if (arena == NULL) {
+        return NULL;
+    }
+    *arena = (arena_t) {
+        .allocator = allocator,
+        .memory = (uint8_t*) arena,
+        .capacity = capacity,
+        .position = sizeof(arena_t),
+        .last_position = sizeof(arena_t),
+        .committed = capacity,
+    };
+    _arena_stats(_arena_stats_register(arena));
+    return arena;
+}
+
+arena_t* arena_create_from_buffer(uint8_t* buffer, size_t capacity) {
+    arena_t* arena = (arena_t*) buffer;
+    *arena = (arena_t) {
+        .allocator = {0},
+        .memory = buffer,
+        .capacity = capacity,
+        .position = sizeof(arena_t),
+        .last_position = sizeof(arena_t),
+        .committed = capacity,
+        .flags = ARENA_FLAG_EXTERNAL,
+    };
+    _arena_stats(_arena_stats_register(arena));
+    return arena;
+}
+
+arena_t* arena_create_chained(allocator_t allocator, size_t block_size) {
+    if (block_size == 0) {
+        block_size = ARENA_DEFAULT_BLOCK_SIZE;
+    }
+    core_assert(block_size > sizeof(arena_t));
+    arena_t* arena = arena_create(allocator, block_size);
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->block_size = block_size;
+    arena->flags |= ARENA_FLAG_CHAINED;
+    return arena;
+}
+
+arena_t* arena_create_chained_from_buffer(uint8_t* buffer, size_t capacity, allocator_t allocator, size_t block_size) {
+    if (block_size == 0) {
+        block_size = ARENA_DEFAULT_BLOCK_SIZE;
+    }
+    arena_t* arena = arena_create_from_buffer(buffer, capacity);
+    arena->allocator = allocator;
+    arena->block_size = block_size;
+    arena->flags |= ARENA_FLAG_CHAINED;
+    return arena;
+}
+
+arena_t* arena_create_reserve(size_t reserve_size, size_t commit_granularity) {
+    size_t page_size = _os_page_size();
+    if (commit_granularity == 0) {
+        commit_granularity = ARENA_DEFAULT_COMMIT_GRANULARITY;
+    }
+    commit_granularity = _align_up(commit_granularity, page_size);
+    reserve_size = _align_up(reserve_size, commit_granularity);
+
+    uint8_t* memory = _os_reserve(reserve_size);
+    if (memory == NULL) {
+        return NULL;
+    }
+    if (!_os_commit(memory, commit_granularity)) {
+        _os_release(memory, reserve_size);
+        return NULL;
+    }
+
+    arena_t* arena = (arena_t*) memory;
+    *arena = (arena_t) {
+        .allocator = {0},
+        .memory = memory,
+        .capacity = reserve_size,
+        .position = sizeof(arena_t),
+        .last_position = sizeof(arena_t),
+        .committed = commit_granularity,
+        .commit_granularity = commit_granularity,
+        .flags = ARENA_FLAG_VIRTUAL,
+    };
+    _arena_stats(_arena_stats_register(arena));
+    return arena;
+}
+
+arena_t* arena_create_desc(const arena_desc_t* desc) {
+    size_t page_size = _os_page_size();
+    size_t commit_granularity = desc->commit_granularity == 0 ? ARENA_DEFAULT_COMMIT_GRANULARITY : desc->commit_granularity;
+    size_t align = page_size;
+    if (desc->pages != ARENA_PAGES_DEFAULT) {
+        align = ARENA_HUGE_PAGE_SIZE;
+    }
+    commit_granularity = _align_up(commit_granularity, align);
+    size_t reserve_size = _align_up(desc->reserve_size, commit_granularity);
+
+    uint8_t* memory = NULL;
+    size_t committed = 0;
+    uint32_t flags = ARENA_FLAG_VIRTUAL | (desc->prefault ? ARENA_FLAG_PREFAULT : 0);
+    if (desc->pages == ARENA_PAGES_HUGE_EXPLICIT) {
+        // Huge page mappings are committed as a whole.
+        memory = _os_alloc_huge_pages(reserve_size, desc->bind_numa_node, desc->numa_node);
+        committed = reserve_size;
+        flags |= memory != NULL ? ARENA_FLAG_HUGE_EXPLICIT : 0;
+    }
+    if (memory == NULL) {
+        memory = desc->bind_numa_node ? _os_reserve_on_node(reserve_size, align, desc->numa_node) : _os_reserve_aligned(reserve_size, align);
+        if (memory == NULL) {
+            return NULL;
+        }
+        if (desc->pages != ARENA_PAGES_DEFAULT) {
+            _os_advise_huge_pages(memory, reserve_size);
+        }
+        if (!_os_commit(memory, commit_granularity)) {
+            _os_release(memory, reserve_size);
+            return NULL;
+        }
+        committed = commit_granularity;
+    }
+    if (desc->prefault) {
+        _os_prefault(memory, committed);
+    }
+
+    arena_t* arena = (arena_t*) memory;
+    *arena = (arena_t) {
+        .allocator = {0},
+        .memory = memory,
+        .capacity = reserve_size,
+        .position = sizeof(arena_t),
+        .last_position = sizeof(arena_t),
+        .committed = committed,
+        .commit_granularity = commit_granularity,
+        .flags = flags,
+    };
+    _arena_stats(_arena_stats_register(arena));
+    return arena;
+}
+
+void arena_destroy(arena_t** arena) {
+    _arena_stats(_arena_stats_unregister(*arena));
+    (*arena)->flags &= ~ARENA_FLAG_DECOMMIT;
+    arena_reset(*arena);
+    arena_trim(*arena);
+    if ((*arena)->flags & ARENA_FLAG_MAPPED) {
+        // Writable maps hold their header inside the mapping.
+        bool detached = (*arena)->flags & ARENA_FLAG_READ_ONLY;
+        _os_unmap_file((*arena)->memory, (*arena)->capacity);
+        if (detached) {
+            _os_release(*arena, sizeof(arena_t));
+        }
+    } else if ((*arena)->flags & ARENA_FLAG_VIRTUAL) {
+        _os_release((*arena)->memory, (*arena)->capacity);
+    } else if (!((*arena)->flags & ARENA_FLAG_EXTERNAL)) {
+        core_free((*arena)->allocator, (*arena)->memory, (*arena)->capacity);
+    }
+    *arena = NULL;
+}
+
+void* _arena_alloc(size_t size, void* context) {
+    arena_t* arena = context;
+    return arena_push(arena, size);
+}
+
+void* _arena_realloc(void* ptr, size_t old_size, size_t new_size, void* context) {
+    arena_t* arena = context;
+    // Resize in place if we're reallocing the last allocation.
+    if (arena_resize_in_place(arena, ptr, new_size) || old_size >= new_size) {
+        return ptr;
+    }
+    void* new_ptr = arena_push(arena, new_size);
+    if (new_ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size);
+    }
+    return new_ptr;
+}
+
+void _arena_free(void* ptr, size_t size, void* context) {
+    unused(size);
+    arena_t* arena = context;
+    // Only the last allocation can be given back.
+    if ((uintptr_t) arena->memory + arena->last_position == (uintptr_t) ptr && !(arena->flags & ARENA_FLAG_READ_ONLY)) {
+        arena->position = arena->last_position;
+        _arena_stats(arena->stats.used_bytes = arena->stats._block_base + arena->position);
+    }
+}
+
+allocator_t arena_allocator(arena_t* arena) {
+    return (allocator_t) {
+        .alloc = _arena_alloc,
+        .realloc = _arena_realloc,
+        .free = _arena_free,
+        .context = arena,
+    };
+}
+
+// Header at the start of every block linked into a chained arena.
+struct _arena_block_t {
+    _arena_block_t* prev;
+    size_t capacity;
+    size_t prev_capacity;
+#if defined(CORE_ARENA_STATS)
+    size_t prev_position;
+#endif
+};
+
+// Commits enough memory for the arena to hold 'required' bytes.
+static bool _arena_commit(arena_t* arena, size_t required) {
+    if (!(arena->flags & ARENA_FLAG_VIRTUAL) || required > arena->capacity) {
+        return false;
+    }
+    size_t committed = _align_up(required, arena->commit_granularity);
+    if (committed > arena->capacity) {
+        committed = arena->capacity;
+    }
+    if (!_os_commit(arena->memory + arena->committed, committed - arena->committed)) {
+        return false;
+    }
+    if (arena->flags & ARENA_FLAG_PREFAULT) {
+        _os_prefault(arena->memory + arena->committed, committed - arena->committed);
+    }
+    arena->committed = committed;
+    return true;
+}
+
+// Makes a block large enough for 'size' bytes at 'align' current, reusing a
+// cached block when one fits.
+static bool _arena_link_block(arena_t* arena, size_t size, size_t align) {
+    if (!(arena->flags & ARENA_FLAG_CHAINED)) {
+        return false;
+    }
+    size_t required = sizeof(_arena_block_t) + size + align;
+
+    _arena_block_t* block = NULL;
+    for (_arena_block_t** it = &arena->free_blocks; *it != NULL; it = &(*it)->prev) {
+        if ((*it)->capacity >= required) {
+            block = *it;
+            *it = block->prev;
+            break;
+        }
+    }
+    if (block == NULL) {
+        size_t capacity = required > arena->block_size ? required : arena->block_size;
+        block = core_alloc(arena->allocator, capacity);
+        if (block == NULL) {
+            return false;
+        }
+        block->capacity = capacity;
+    }
+
+    block->prev = arena->block;
+    block->prev_capacity = arena->capacity;
+    _arena_stats(block->prev_position = arena->position);
+    _arena_stats(arena->stats._block_base += arena->position);
+    arena->block = block;
+    arena->memory = (uint8_t*) block;
+    arena->capacity = block->capacity;
+    arena->committed = block->capacity;
+    arena->position = sizeof(_arena_block_t);
+    arena->last_position = sizeof(_arena_block_t);
+    return true;
+}
+
+// Moves the newest block onto the free list and makes its predecessor current.
+static void _arena_unlink_block(arena_t* arena) {
+    _arena_block_t* block = arena->block;
+    arena->block = block->prev;
+    arena->memory = block->prev == NULL ? (uint8_t*) arena : (uint8_t*) block->prev;
+    arena->capacity = block->prev_capacity;
+    arena->committed = block->prev_capacity;
+    _arena_stats(arena->stats._block_base -= block->prev_position);
+
+    block->prev = arena->free_blocks;
+    arena->free_blocks = block;
+}
+
+void* arena_push_aligned(arena_t* arena, size_t size, size_t align) {
+    uintptr_t current_ptr = (uintptr_t) arena->memory + arena->position;
+    uintptr_t aligned_ptr = _align_up(current_ptr, align);
+    uintptr_t position = aligned_ptr - (uintptr_t) arena->memory;
+    if (position + size > arena->committed && !_arena_commit(arena, position + size)) {
+        if (!_arena_link_block(arena, size, align)) {
+            _arena_stats(arena->stats.failed_push_count++);
+            return NULL;
+        }
+        return arena_push_aligned(arena, size, align);
+    }
+    arena->last_position = position;
+    arena->position = position + size;
+    _arena_stats(arena->stats.push_count++);
+    _arena_stats(arena->stats.padding_bytes += aligned_ptr - current_ptr);
+    _arena_stats(_arena_stats_update_usage(arena));
+    return &arena->memory[position];
+}
+
+void* arena_push(arena_t* arena, size_t size) {
+    return arena_push_aligned(arena, size, sizeof(void*));
+}
+
+void arena_pop(arena_t* arena, size_t size) {
+    if (arena->flags & ARENA_FLAG_READ_ONLY) {
+        return;
+    }
+    size_t start = arena->block == NULL ? sizeof(arena_t) : sizeof(_arena_block_t);
+    arena->position = arena->position - start > size ? arena->position - size : start;
+    if (arena->last_position > arena->position) {
+        arena->last_position = arena->position;
+    }
+    _arena_stats(arena->stats.used_bytes = arena->stats._block_base + arena->position);
+}
+
+bool arena_resize_in_place(arena_t* arena, void* ptr, size_t new_size) {
+    if ((uintptr_t) arena->memory + arena->last_position != (uintptr_t) ptr || (arena->flags & ARENA_FLAG_READ_ONLY)) {
+        return false;
+    }
+    size_t end = arena->last_position + new_size;
+    if (end > arena->committed && !_arena_commit(arena, end)) {
+        return false;
+    }
+    arena->position = end;
+    _arena_stats(_arena_stats_update_usage(arena));
+    return true;
+}
+
+void arena_set_decommit_policy(arena_t* arena, size_t retain_size, size_t hysteresis) {
+    // Decommitted hugetlb pages fault back in from a pool that may be empty,
+    // and Windows can't decommit large pages at all.
+    if (!(arena->flags & ARENA_FLAG_VIRTUAL) || (arena->flags & (ARENA_FLAG_MAPPED | ARENA_FLAG_HUGE_EXPLICIT))) {
+        return;
+    }
+    arena->decommit_retain = retain_size;
+    arena->decommit_hysteresis = hysteresis;
+    arena->rewind_peak = arena->position;
+    arena->flags |= ARENA_FLAG_DECOMMIT;
+}
+
+// Called before a rewind to 'position' while 'arena->position' still holds
+// the position being rewound from.
+static void _arena_decommit_rewind(arena_t* arena, size_t position) {
+    size_t peak = arena->position > arena->rewind_peak ? arena->position : arena->rewind_peak;
+    arena->rewind_peak = arena->position;
+
+    size_t keep = peak > arena->decommit_retain ? peak : arena->decommit_retain;
+    if (keep < position) {
+        keep = position;
+    }
+    keep = _align_up(keep, arena->commit_granularity);
+    if (keep >= arena->committed || arena->committed - keep < arena->decommit_hysteresis) {
+        return;
+    }
+    _os_decommit(arena->memory + keep, arena->committed - keep);
+    arena->committed = keep;
+}
+
+void arena_reset(arena_t* arena) {
+    if (arena->flags & ARENA_FLAG_READ_ONLY) {
+        return;
+    }
+    while (arena->block != NULL) {
+        _arena_unlink_block(arena);
+    }
+    if (arena->flags & ARENA_FLAG_DECOMMIT) {
+        _arena_decommit_rewind(arena, sizeof(arena_t));
+    }
+    arena->position = sizeof(arena_t);
+    arena->last_position = sizeof(arena_t);
+    _arena_stats(arena->stats.reset_count++);
+    _arena_stats(arena->stats.used_bytes = arena->position);
+}
+
+void arena_trim(arena_t* arena) {
+    while (arena->free_blocks != NULL) {
+        _arena_block_t* block = arena->free_blocks;
+        arena->free_blocks = block->prev;
+        core_free(arena->allocator, block, block->capacity);
+    }
+}
+
+arena_scope_t arena_scope_begin(arena_t* arena) {
+#if defined(CORE_ARENA_STATS)
+    if (++arena->stats.scope_depth > arena->stats.max_scope_depth) {
+        arena->stats.max_scope_depth = arena->stats.scope_depth;
+    }
+#endif
+    return (arena_scope_t) {
+        .arena = arena,
+        .memory = arena->memory,
+        .position = arena->position,
+        .last_position = arena->last_position,
+    };
+}
+
+void arena_scope_end(arena_scope_t* scope) {
+    arena_t* arena = scope->arena;
+    while (arena->memory != scope->memory) {
+        _arena_unlink_block(arena);
+    }
+    if (arena->flags & ARENA_FLAG_DECOMMIT) {
+        _arena_decommit_rewind(arena, scope->position);
+    }
+    arena->position = scope->position;
+    arena->last_position = scope->last_position;
+    _arena_stats(arena->stats.scope_rewind_count++);
+    _arena_stats(arena->stats.scope_depth--);
+    _arena_stats(arena->stats.used_bytes = arena->stats._block_base + arena->position);
+    *scope = (arena_scope_t) {0};
+}
+
+// Written in place of the arena header, which is rebuilt on load anyway. The
+// magic reads differently on a machine of the other byte order and
+// 'arena_size' changes with CORE_ARENA_STATS and the pointer size.
+#define _ARENA_SNAPSHOT_MAGIC 0x414e5248u
+#define _ARENA_SNAPSHOT_VERSION 1
+
+typedef struct _arena_snapshot_t _arena_snapshot_t;
+struct _arena_snapshot_t {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t arena_size;
+    uint64_t position;
+    uint64_t last_position;
+};
+
+bool arena_save(const arena_t* arena, const char* path) {
+    bool detached = arena->flags & ARENA_FLAG_READ_ONLY;
+    if (arena->block != NULL || (!detached && (uint8_t*) arena != arena->memory)) {
+        return false;
+    }
+    uint8_t header[sizeof(arena_t)] = {0};
+    _arena_snapshot_t snapshot = {
+        .magic = _ARENA_SNAPSHOT_MAGIC,
+        .version = _ARENA_SNAPSHOT_VERSION,
+        .arena_size = sizeof(arena_t),
+        .position = arena->position,
+        .last_position = arena->last_position,
+    };
+    core_assert(sizeof(snapshot) <= sizeof(header));
+    memcpy(header, &snapshot, sizeof(snapshot));
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    size_t size = arena->position - sizeof(arena_t);
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+        fwrite(arena->memory + sizeof(arena_t), 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+arena_t* arena_map(const char* path, size_t reserve_size, bool writable) {
+    size_t mapped_size = 0;
+    size_t file_size = 0;
+    uint8_t* memory = _os_map_file(path, reserve_size, writable, &mapped_size, &file_size);
+    if (memory == NULL) {
+        return NULL;
+    }
+    _arena_snapshot_t snapshot = {0};
+    if (file_size >= sizeof(arena_t)) {
+        memcpy(&snapshot, memory, sizeof(snapshot));
+    }
+    if (snapshot.magic != _ARENA_SNAPSHOT_MAGIC || snapshot.version != _ARENA_SNAPSHOT_VERSION ||
+            snapshot.arena_size != sizeof(arena_t) || snapshot.position != file_size ||
+            snapshot.last_position < sizeof(arena_t) || snapshot.last_position > snapshot.position) {
+        _os_unmap_file(memory, mapped_size);
+        return NULL;
+    }
+
+    // Pages past the file are committed on demand like a reserve arena. A
+    // read-only map commits exactly the file, so with rewinds ignored every
+    // push takes the commit path and fails.
+    arena_t* arena = (arena_t*) memory;
+    if (!writable) {
+        arena = _os_alloc_pages(sizeof(arena_t));
+        if (arena == NULL) {
+            _os_unmap_file(memory, mapped_size);
+            return NULL;
+        }
+    }
+    size_t page_size = _os_page_size();
+    size_t position = (size_t) snapshot.position;
+    size_t last_position = (size_t) snapshot.last_position;
+    *arena = (arena_t) {
+        .allocator = {0},
+        .memory = memory,
+        .capacity = mapped_size,
+        .position = position,
+        .last_position = last_position,
+        .committed = writable ? _align_up(file_size, page_size) : position,
+        .commit_granularity = page_size,
+        .flags = ARENA_FLAG_MAPPED | (writable ? ARENA_FLAG_VIRTUAL : ARENA_FLAG_READ_ONLY),
+    };
+    if (arena->committed > mapped_size) {
+        arena->committed = mapped_size;
+    }
+    _arena_stats(_arena_stats_register(arena));
+    return arena;
+}
+
+size_t arena_offset_of(const arena_t* arena, const void* ptr) {
+    core_assert_msg((uintptr_t) ptr >= (uintptr_t) arena->memory && (uintptr_t) ptr <= (uintptr_t) arena->memory + arena->position, "Pointer outside of the arena");
+    return (uintptr_t) ptr - (uintptr_t) arena->memory;
+}
+
+void* arena_ptr_at(const arena_t* arena, size_t offset) {
+    core_assert_msg(offset <= arena->position, "Offset outside of the arena");
+    return arena->memory + offset;
+}
+
+static core_thread_local arena_t* t_scratch_arenas[CORE_SCRATCH_ARENA_COUNT] = {0};
+
+arena_scope_t scratch_begin(arena_t* const* conflicts, size_t count) {
+    for (uint32_t i = 0; i < CORE_SCRATCH_ARENA_COUNT; i++) {
+        arena_t** arena = &t_scratch_arenas[i];
+        bool conflicting = false;
+        for (size_t j = 0; j < count; j++) {
+            if (*arena != NULL && conflicts[j] == *arena) {
+                conflicting = true;
+                break;
+            }
+        }
+        if (conflicting) {
+            continue;
+        }
+
+        if (*arena == NULL) {
+            *arena = arena_create_reserve(CORE_SCRATCH_ARENA_RESERVE, 0);
+            core_assert_msg(*arena != NULL, "Failed to reserve scratch arena");
+        }
+        return arena_scope_begin(*arena);
+    }
+    core_assert_msg(false, "Every scratch arena conflicts, increase CORE_SCRATCH_ARENA_COUNT");
+    return (arena_scope_t) {0};
+}
+
+void scratch_end(arena_scope_t* scope) {
+    arena_scope_end(scope);
+}
+
+void scratch_release(void) {
+    for (uint32_t i = 0; i < CORE_SCRATCH_ARENA_COUNT; i++) {
+        if (t_scratch_arenas[i] != NULL) {
+            arena_destroy(&t_scratch_arenas[i]);
+        }
+    }
+}
+
+// =============================================================================
+// CONCURRENT ARENA
+// =============================================================================
+
+concurrent_arena_t* concurrent_arena_create(allocator_t allocator, size_t capacity) {
+    concurrent_arena_t* arena = core_alloc(allocator, capacity);
+    *arena = (concurrent_arena_t) {
+        .allocator = allocator,
+        .memory = (uint8_t*) arena,
+        .capacity = capacity,
+    };
+    atomic_init(&arena->position, sizeof(concurrent_arena_t));
+    return arena;
+}
+
+concurrent_arena_t* concurrent_arena_create_from_buffer(uint8_t* buffer, size_t capacity) {
+    core_assert((uintptr_t) buffer % CONCURRENT_ARENA_ALIGN == 0);
+    concurrent_arena_t* arena = (concurrent_arena_t*) buffer;
+    *arena = (concurrent_arena_t) {
+        .allocator = {0},
+        .memory = buffer,
+        .capacity = capacity,
+    };
+    atomic_init(&arena->position, sizeof(concurrent_arena_t));
+    return arena;
+}
+
+void concurrent_arena_destroy(concurrent_arena_t** arena) {
+    if ((*arena)->allocator.free != NULL) {
+        core_free((*arena)->allocator, (*arena)->memory, (*arena)->capacity);
+    }
+    *arena = NULL;
+}
+
+static void* _concurrent_arena_alloc(size_t size, void* context) {
+    concurrent_arena_t* arena = context;
+    return concurrent_arena_push(arena, size);
+}
+
+static void* _concurrent_arena_realloc(void* ptr, size_t old_size, size_t new_size, void* context) {
+    if (old_size >= new_size) {
+        return ptr;
+    }
+    concurrent_arena_t* arena = context;
+    // Extend in place if nobody has pushed since 'ptr' was allocated.
+    size_t offset = (uint8_t*) ptr - arena->memory;
+    size_t expected = offset + _align_up(old_size, CONCURRENT_ARENA_ALIGN);
+    size_t desired = offset + _align_up(new_size, CONCURRENT_ARENA_ALIGN);
+    if (desired <= arena->capacity &&
+            atomic_compare_exchange_strong_explicit(&arena->position, &expected, desired, memory_order_relaxed, memory_order_relaxed)) {
+        return ptr;
+    }
+    void* new_ptr = concurrent_arena_push(arena, new_size);
+    if (new_ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size);
+    }
+    return new_ptr;
+}
+
+static void _concurrent_arena_free(void* ptr, size_t size, void* context) {
+    concurrent_arena_t* arena = context;
+    // Give the memory back if it's still the last allocation.
+    size_t offset = (uint8_t*) ptr - arena->memory;
+    size_t expected = offset + _align_up(size, CONCURRENT_ARENA_ALIGN);
+    atomic_compare_exchange_strong_explicit(&arena->position, &expected, offset, memory_order_relaxed, memory_order_relaxed);
+}
+
+allocator_t concurrent_arena_allocator(concurrent_arena_t* arena) {
+    return (allocator_t) {
+        .alloc = _concurrent_arena_alloc,
+        .realloc = _concurrent_arena_realloc,
+        .free = _concurrent_arena_free,
+        .context = arena,
+    };
+}
+
+void* concurrent_arena_push_aligned(concurrent_arena_t* arena, size_t size, size_t align) {
+    // Sizes are rounded so 'position' always stays CONCURRENT_ARENA_ALIGN aligned.
+    size = _align_up(size, CONCURRENT_ARENA_ALIGN);
+    if (align <= CONCURRENT_ARENA_ALIGN) {
+        size_t position = atomic_fetch_add_explicit(&arena->position, size, memory_order_relaxed);
+        if (position + size > arena->capacity) {
+            return NULL;
+        }
+        return &arena->memory[position];
+    }
+
+    size_t position = atomic_load_explicit(&arena->position, memory_order_relaxed);
+    size_t aligned;
+    do {
+        aligned = _align_up((uintptr_t) arena->memory + position, align) - (uintptr_t) arena->memory;
+        if (aligned + size > arena->capacity) {
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&arena->position, &position, aligned + size, memory_order_relaxed, memory_order_relaxed));
+    return &arena->memory[aligned];
+}
+
+void* concurrent_arena_push(concurrent_arena_t* arena, size_t size) {
+    return concurrent_arena_push_aligned(arena, size, CONCURRENT_ARENA_ALIGN);
+}
+
+void concurrent_arena_reset(concurrent_arena_t* arena) {
+    atomic_store_explicit(&arena->position, sizeof(concurrent_arena_t), memory_order_relaxed);
+}
+
+// =============================================================================
+// POOL ALLOCATOR
+// =============================================================================
+
+struct _pool_node_t {
+    _pool_node_t* next;
+};
+
+struct _pool_block_t {
+    _pool_block_t* next;
+    size_t size;
+};
+
+// Keeps elements at the start of a block 16 byte aligned.
+#define _POOL_BLOCK_HEADER_SIZE 16
+
+pool_t* pool_create(allocator_t allocator, size_t element_size, size_t block_count) {
+    if (block_count == 0) {
+        block_count = POOL_DEFAULT_BLOCK_COUNT;
+    }
+    if (element_size < sizeof(_pool_node_t)) {
+        element_size = sizeof(_pool_node_t);
+    }
+    pool_t* pool = core_alloc(allocator, sizeof(pool_t));
+    *pool = (pool_t) {
+        .allocator = allocator,
+        .element_size = _align_up(element_size, sizeof(void*)),
+        .block_count = block_count,
+    };
+    return pool;
+}
+
+static void _pool_free_blocks(pool_t* pool) {
+    _pool_block_t* block = pool->blocks;
+    while (block != NULL) {
+        _pool_block_t* next = block->next;
+        core_free(pool->allocator, block, block->size);
+        block = next;
+    }
+    pool->blocks = NULL;
+    pool->free_list = NULL;
+    pool->cursor = NULL;
+    pool->end = NULL;
+}
+
+void pool_destroy(pool_t** pool) {
+    _pool_free_blocks(*pool);
+    core_free((*pool)->allocator, *pool, sizeof(pool_t));
+    *pool = NULL;
+}
+
+void* pool_alloc(pool_t* pool) {
+    _pool_node_t* node = pool->free_list;
+    if (node != NULL) {
+        pool->free_list = node->next;
+        return node;
+    }
+
+    if (pool->cursor == pool->end) {
+        size_t size = _POOL_BLOCK_HEADER_SIZE + pool->element_size * pool->block_count;
+        _pool_block_t* block = core_alloc(pool->allocator, size);
+        if (block == NULL) {
+            return NULL;
+        }
+        *block = (_pool_block_t) {
+            .next = pool->blocks,
+            .size = size,
+        };
+        pool->blocks = block;
+        pool->cursor = (uint8_t*) block + _POOL_BLOCK_HEADER_SIZE;
+        pool->end = (uint8_t*) block + size;
+    }
+    void* ptr = pool->cursor;
+    pool->cursor += pool->element_size;
+    return ptr;
+}
+
+void pool_free(pool_t* pool, void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    _pool_node_t* node = ptr;
+    node->next = pool->free_list;
+    pool->free_list = node;
+}
+
+static void* _pool_alloc(size_t size, void* context) {
+    pool_t* pool = context;
+    core_assert_msg(size <= pool->element_size, "Allocation of %zu bytes exceeds pool element size of %zu", size, pool->element_size);
+    return pool_alloc(pool);
+}
+
+static void* _pool_realloc(void* ptr, size_t old_size, size_t new_size, void* context) {
+    unused(old_size);
+    if (ptr == NULL) {
+        return _pool_alloc(new_size, context);
+    }
+    pool_t* pool = context;
+    core_assert_msg(new_size <= pool->element_size, "Allocation of %zu bytes exceeds pool element size of %zu", new_size, pool->element_size);
+    return ptr;
+}
+
+static void _pool_free(void* ptr, size_t size, void* context) {
+    unused(size);
+    pool_free(context, ptr);
+}
+
+allocator_t pool_allocator(pool_t* pool) {
+    return (allocator_t) {
+        .alloc = _pool_alloc,
+        .realloc = _pool_realloc,
+        .free = _pool_free,
+        .context = pool,
+    };
+}
+
+// =============================================================================
+// HEAP ALLOCATOR
+// =============================================================================
+
+// Classes are 16, 32, 48 and 64 bytes followed by four evenly spaced classes
+// per power of two, keeping internal fragmentation below 25%.
+static uint32_t _heap_class_index(size_t size) {
+    if (size <= 64) {
+        return size == 0 ? 0 : (uint32_t) (size - 1) / 16;
+    }
+    uint32_t exponent = _log2_floor(size - 1);
+    return 4 + (exponent - 6) * 4 + (uint32_t) ((size - 1 - ((size_t) 1 << exponent)) >> (exponent - 2));
+}
+
+static size_t _heap_class_size(uint32_t index) {
+    if (index < 4) {
+        return (index + 1) * 16;
+    }
+    uint32_t exponent = 6 + (index - 4) / 4;
+    return ((size_t) 1 << exponent) + ((index - 4) % 4 + 1) * ((size_t) 1 << (exponent - 2));
+}
+
+heap_t* heap_create(allocator_t allocator) {
+    heap_t* heap = core_alloc(allocator, sizeof(heap_t));
+    heap->allocator = allocator;
+    for (uint32_t i = 0; i < HEAP_CLASS_COUNT; i++) {
+        size_t element_size = _heap_class_size(i);
+        heap->classes[i] = (pool_t) {
+            .allocator = allocator,
+            .element_size = element_size,
+            .block_count = (HEAP_SLAB_SIZE - _POOL_BLOCK_HEADER_SIZE) / element_size,
+        };
+    }
+    return heap;
+}
+
+void heap_destroy(heap_t** heap) {
+    for (uint32_t i = 0; i < HEAP_CLASS_COUNT; i++) {
+        _pool_free_blocks(&(*heap)->classes[i]);
+    }
+    core_free((*heap)->allocator, *heap, sizeof(heap_t));
+    *heap = NULL;
+}
+
+void* heap_alloc(heap_t* heap, size_t size) {
+    if (size > HEAP_MAX_CLASS_SIZE) {
+        return core_alloc(heap->allocator, size);
+    }
+    return pool_alloc(&heap->classes[_heap_class_index(size)]);
+}
+
+void* heap_realloc(heap_t* heap, void* ptr, size_t old_size, size_t new_size) {
+    if (ptr == NULL) {
+        return heap_alloc(heap, new_size);
+    }
+    if (old_size > HEAP_MAX_CLASS_SIZE && new_size > HEAP_MAX_CLASS_SIZE) {
+        return core_realloc(heap->allocator, ptr, old_size, new_size);
+    }
+    if (old_size <= HEAP_MAX_CLASS_SIZE && new_size <= HEAP_MAX_CLASS_SIZE &&
+            _heap_class_index(old_size) == _heap_class_index(new_size)) {
+        return ptr;
+    }
+    void* new_ptr = heap_alloc(heap, new_size);
+    if (new_ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+        heap_free(heap, ptr, old_size);
+    }
+    return new_ptr;
+}
+
+void heap_free(heap_t* heap, void* ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (size > HEAP_MAX_CLASS_SIZE) {
+        core_free(heap->allocator, ptr, size);
+        return;
+    }
+    pool_free(&heap->classes[_heap_class_index(size)], ptr);
+}
+
+static void* _heap_alloc(size_t size, void* context) {
+    return heap_alloc(context, size);
+}
+
+static void* _heap_realloc(void* ptr, size_t old_size, size_t new_size, void* context) {
+    return heap_realloc(context, ptr, old_size, new_size);
+}
+
+static void _heap_free(void* ptr, size_t size, void* context) {
+    heap_free(context, ptr, size);
+}
+
+allocator_t heap_allocator(heap_t* heap) {
+    return (allocator_t) {
+        .alloc = _heap_alloc,
+        .realloc = _heap_realloc,
+        .free = _heap_free,
+        .context = heap,
+    };
+}
+
+// =============================================================================
+// TRACKING ALLOCATOR
+// =============================================================================
+
+core_thread_local const char* _tracking_site_file = NULL;
+core_thread_local int32_t _tracking_site_line = 0;
+
+static _Atomic uint32_t g_tracking_next_shard = 0;
+static core_thread_local uint32_t t_tracking_shard = UINT32_MAX;
+
+// Keeps the allocation behind it 16 byte aligned.
+#define _TRACKING_HEADER_SIZE 16
+
+typedef struct _tracking_header_t _tracking_header_t;
+struct _tracking_header_t {
+    // Index into the site table plus one, 0 when unknown.
+    uint32_t site;
+};
+
+tracking_allocator_t* tracking_allocator_create(allocator_t allocator) {
+    tracking_allocator_t* tracker = core_alloc(allocator, sizeof(tracking_allocator_t));
+    memset(tracker, 0, sizeof(tracking_allocator_t));
+    tracker->allocator = allocator;
+    atomic_flag_clear(&tracker->site_lock);
+    return tracker;
+}
+
+void tracking_allocator_destroy(tracking_allocator_t** tracker) {
+    core_free((*tracker)->allocator, *tracker, sizeof(tracking_allocator_t));
+    *tracker = NULL;
+}
+
+static _tracking_shard_t* _tracking_shard(tracking_allocator_t* tracker) {
+    if (t_tracking_shard == UINT32_MAX) {
+        t_tracking_shard = atomic_fetch_add_explicit(&g_tracking_next_shard, 1, memory_order_relaxed) % TRACKING_SHARD_COUNT;
+    }
+    return &tracker->shards[t_tracking_shard];
+}
+
+static void _tracking_add_live(tracking_allocator_t* tracker, _tracking_shard_t* shard, int64_t delta) {
+    int64_t pending = atomic_fetch_add_explicit(&shard->pending_bytes, delta, memory_order_relaxed) + delta;
+    if (pending < TRACKING_PEAK_BATCH_BYTES && pending > -TRACKING_PEAK_BATCH_BYTES) {
+        return;
+    }
+    pending = atomic_exchange_explicit(&shard->pending_bytes, 0, memory_order_relaxed);
+    int64_t live = atomic_fetch_add_explicit(&tracker->live_bytes, pending, memory_order_relaxed) + pending;
+    int64_t peak = atomic_load_explicit(&tracker->peak_bytes, memory_order_relaxed);
+    while (live > peak && !atomic_compare_exchange_weak_explicit(&tracker->peak_bytes, &peak, live, memory_order_relaxed, memory_order_relaxed));
+}
+
+static void _tracking_count_allocation(_tracking_shard_t* shard, size_t size) {
+    uint32_t bucket = size == 0 ? 0 : _log2_floor(size);
+    if (bucket >= TRACKING_HISTOGRAM_BUCKETS) {
+        bucket = TRACKING_HISTOGRAM_BUCKETS - 1;
+    }
+    atomic_fetch_add_explicit(&shard->histogram[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->allocated_bytes, size, memory_order_relaxed);
+}
+
+// Finds or inserts the calling thread's pending site. Lookups are lock free,
+// insertions take the lock and publish 'file' last.
+static uint32_t _tracking_site_index(tracking_allocator_t* tracker) {
+    const char* file = _tracking_site_file;
+    if (file == NULL) {
+        return 0;
+    }
+    int32_t line = _tracking_site_line;
+    uint32_t mask = TRACKING_MAX_SITES - 1;
+    uint32_t index = (uint32_t) (((uintptr_t) file >> 3) * 31 + (uint32_t) line) * 2654435761u & mask;
+    for (uint32_t probe = 0; probe < TRACKING_MAX_SITES; probe++, index = (index + 1) & mask) {
+        _tracking_site_t* site = &tracker->sites[index];
+        const char* site_file = atomic_load_explicit(&site->file, memory_order_acquire);
+        if (site_file == NULL) {
+            while (atomic_flag_test_and_set_explicit(&tracker->site_lock, memory_order_acquire)) {
+                _os_yield();
+            }
+            site_file = atomic_load_explicit(&site->file, memory_order_relaxed);
+            if (site_file == NULL) {
+                site->line = line;
+                atomic_store_explicit(&site->file, file, memory_order_release);
+                atomic_fetch_add_explicit(&tracker->site_count, 1, memory_order_relaxed);
+                site_file = file;
+            }
+            atomic_flag_clear_explicit(&tracker->site_lock, memory_order_release);
+        }
+        if (site_file == file && site->line == line) {
+            return index + 1;
+        }
+    }
+    // Table is full, count it as unknown.
+    return 0;
+}
+
+static void _tracking_site_add(tracking_allocator_t* tracker, uint32_t site_index, int64_t delta, size_t allocated) {
+    if (site_index == 0) {
+        return;
+    }
+    _tracking_site_t* site = &tracker->sites[site_index - 1];
+    atomic_fetch_add_explicit(&site->live_bytes, delta, memory_order_relaxed);
+    if (allocated > 0) {
+        atomic_fetch_add_explicit(&site->allocation_count, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&site->allocated_bytes, allocated, memory_order_relaxed);
+    }
+}
+
+static void* _tracking_alloc(size_t size, void* context) {
+    tracking_allocator_t* tracker = context;
+    uint8_t* memory = core_alloc(tracker->allocator, size + _TRACKING_HEADER_SIZE);
+    if (memory == NULL) {
+        return NULL;
+    }
+    _tracking_header_t* header = (_tracking_header_t*) memory;
+    header->site = _tracking_site_index(tracker);
+
+    _tracking_shard_t* shard = _tracking_shard(tracker);
+    atomic_fetch_add_explicit(&shard->allocation_count, 1, memory_order_relaxed);
+    _tracking_count_allocation(shard, size);
+    _tracking_add_live(tracker, shard, (int64_t) size);
+    _tracking_site_add(tracker, header->site, (int64_t) size, size);
+    return memory + _TRACKING_HEADER_SIZE;
+}
+
+static void _tracking_free(void* ptr, size_t size, void* context) {
+    if (ptr == NULL) {
+        return;
+    }
+    tracking_allocator_t* tracker = context;
+    uint8_t* memory = (uint8_t*) ptr - _TRACKING_HEADER_SIZE;
+    uint32_t site = ((_tracking_header_t*) memory)->site;
+    core_free(tracker->allocator, memory, size + _TRACKING_HEADER_SIZE);
+
+    _tracking_shard_t* shard = _tracking_shard(tracker);
+    atomic_fetch_add_explicit(&shard->free_count, 1, memory_order_relaxed);
+    _tracking_add_live(tracker, shard, -(int64_t) size);
+    _tracking_site_add(tracker, site, -(int64_t) size, 0);
+}
+
+// Reallocations stay attributed to the site of the original allocation.
+static void* _tracking_realloc(void* ptr, size_t old_size, size_t new_size, void* context) {
+    if (ptr == NULL) {
+        return _tracking_alloc(new_size, context);
+    }
+    tracking_allocator_t* tracker = context;
+    uint8_t* memory = core_realloc(tracker->allocator, (uint8_t*) ptr - _TRACKING_HEADER_SIZE, old_size + _TRACKING_HEADER_SIZE, new_size + _TRACKING_HEADER_SIZE);
+    if (memory == NULL) {
+        return NULL;
+    }
+    uint32_t site = ((_tracking_header_t*) memory)->site;
+
+    _tracking_shard_t* shard = _tracking_shard(tracker);
+    atomic_fetch_add_explicit(&shard->realloc_count, 1, memory_order_relaxed);
+    int64_t delta = (int64_t) new_size - (int64_t) old_size;
+    if (delta > 0) {
+        atomic_fetch_add_explicit(&shard->allocated_bytes, (uint64_t) delta, memory_order_relaxed);
+    }
+    _tracking_add_live(tracker, shard, delta);
+    _tracking_site_add(tracker, site, delta, 0);
+    return memory + _TRACKING_HEADER_SIZE;
+}
+
+allocator_t tracking_allocator(tracking_allocator_t* tracker) {
+    return (allocator_t) {
+        .alloc = _tracking_alloc,
+        .realloc = _tracking_realloc,
+        .free = _tracking_free,
+        .context = tracker,
+    };
+}
+
+void tracking_allocator_snapshot(tracking_allocator_t* tracker, tracking_stats_t* stats) {
+    *stats = (tracking_stats_t) {0};
+    int64_t live = atomic_load_explicit(&tracker->live_bytes, memory_order_relaxed);
+    for (uint32_t i = 0; i < TRACKING_SHARD_COUNT; i++) {
+        _tracking_shard_t* shard = &tracker->shards[i];
+        live += atomic_load_explicit(&shard->pending_bytes, memory_order_relaxed);
+        stats->allocation_count += atomic_load_explicit(&shard->allocation_count, memory_order_relaxed);
+        stats->free_count += atomic_load_explicit(&shard->free_count, memory_order_relaxed);
+        stats->realloc_count += atomic_load_explicit(&shard->realloc_count, memory_order_relaxed);
+        stats->allocated_bytes += atomic_load_explicit(&shard->allocated_bytes, memory_order_relaxed);
+        for (uint32_t j = 0; j < TRACKING_HISTOGRAM_BUCKETS; j++) {
+            stats->histogram[j] += atomic_load_explicit(&shard->histogram[j], memory_order_relaxed);
+        }
+    }
+    int64_t peak = atomic_load_explicit(&tracker->peak_bytes, memory_order_relaxed);
+    stats->live_bytes = live < 0 ? 0 : (uint64_t) live;
+    stats->peak_bytes = peak > live ? (uint64_t) peak : stats->live_bytes;
+}
+
+size_t tracking_allocator_sites(tracking_allocator_t* tracker, tracking_site_stats_t* sites, size_t capacity) {
+    size_t count = 0;
+    for (uint32_t i = 0; i < TRACKING_MAX_SITES; i++) {
+        _tracking_site_t* site = &tracker->sites[i];
+        const char* file = atomic_load_explicit(&site->file, memory_order_acquire);
+        if (file == NULL) {
+            continue;
+        }
+        if (count < capacity) {
+            int64_t live = atomic_load_explicit(&site->live_bytes, memory_order_relaxed);
+            sites[count] = (tracking_site_stats_t) {
+                .file = file,
+                .line = site->line,
+                .live_bytes = live < 0 ? 0 : (uint64_t) live,
+                .allocation_count = atomic_load_explicit(&site->allocation_count, memory_order_relaxed),
+                .allocated_bytes = atomic_load_explicit(&site->allocated_bytes, memory_order_relaxed),
+            };
+        }
+        count++;
+    }
+    return count;
+}
+
+// =============================================================================
+// DYNAMIC ARRAY
+// =============================================================================
+
+#define _DYN_ARR_INITIAL_SIZE 8
+
+static inline void* _header_to_dyn_arr(_dyn_arr_header_t* header) {
+    return &header[1];
+}
+
+void* dyn_arr_create(allocator_t allocator, size_t element_size) {
+    return dyn_arr_create_with_capacity(allocator, element_size, _DYN_ARR_INITIAL_SIZE);
+}
+
+void* dyn_arr_create_with_capacity(allocator_t allocator, size_t element_size, size_t capacity) {
+    _dyn_arr_header_t* header = core_alloc(allocator, sizeof(_dyn_arr_header_t) + element_size * capacity);
+    *header = (_dyn_arr_header_t) {
+        .allocator = allocator,
+        .element_size = element_size,
+        .capacity = capacity,
+        .length = 0,
+        .growth_factor = DYN_ARR_DEFAULT_GROWTH_FACTOR,
+    };
     return _header_to_dyn_arr(header);
 }
 
-void dyn_arr_destroy(void** dyn_arr) {
-    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
-    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
-    core_free(header->allocator, header, sizeof(_dyn_arr_header_t) + header->element_size * _DYN_ARR_INITIAL_SIZE);
-    *dyn_arr = NULL;
+void dyn_arr_destroy(void** dyn_arr) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    core_free(header->allocator, header, sizeof(_dyn_arr_header_t) + header->element_size * header->capacity);
+    *dyn_arr = NULL;
+}
+
+size_t dyn_arr_length(const void* dyn_arr) {
+    if (dyn_arr == NULL) {
+        return 0;
+    }
+    return _dyn_arr_to_header(dyn_arr)->length;
+}
+
+size_t dyn_arr_capacity(const void* dyn_arr) {
+    if (dyn_arr == NULL) {
+        return 0;
+    }
+    return _dyn_arr_to_header(dyn_arr)->capacity;
+}
+
+void dyn_arr_clear(void** dyn_arr) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    header->length = 0;
+}
+
+static void _dyn_arr_set_capacity(void** dyn_arr, size_t capacity) {
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    header = core_realloc(header->allocator,
+            header,
+            sizeof(_dyn_arr_header_t) + header->capacity * header->element_size,
+            sizeof(_dyn_arr_header_t) + capacity * header->element_size);
+    header->capacity = capacity;
+    *dyn_arr = _header_to_dyn_arr(header);
+}
+
+static inline bool _dyn_arr_equal(const void* a, const void* b, size_t element_size, dyn_arr_compare_func_t compare, void* userdata) {
+    return compare == NULL ? memcmp(a, b, element_size) == 0 : compare(a, b, userdata) == 0;
+}
+
+void _dyn_arr_ensure_capacity(void** dyn_arr, size_t length) {
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    size_t required = header->length + length;
+    if (header->capacity >= required) {
+        return;
+    }
+    size_t new_capacity = (size_t) (header->capacity * header->growth_factor);
+    if (new_capacity < required) {
+        new_capacity = required;
+    }
+    _dyn_arr_set_capacity(dyn_arr, new_capacity);
+}
+
+void dyn_arr_reserve(void** dyn_arr, size_t capacity) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    if (_dyn_arr_to_header(*dyn_arr)->capacity < capacity) {
+        _dyn_arr_set_capacity(dyn_arr, capacity);
+    }
+}
+
+void dyn_arr_shrink_to_fit(void** dyn_arr) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    if (header->capacity > header->length) {
+        _dyn_arr_set_capacity(dyn_arr, header->length);
+    }
+}
+
+void dyn_arr_set_growth_factor(void* dyn_arr, float growth_factor) {
+    core_assert_msg(dyn_arr != NULL, "Null pointer dereference");
+    core_assert_msg(growth_factor > 1.0f, "Growth factor must be greater than 1");
+    _dyn_arr_to_header(dyn_arr)->growth_factor = growth_factor;
+}
+
+void dyn_arr_insert_arr(void** dyn_arr, size_t index, const void* arr, size_t arr_length) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    core_assert_msg(index <= header->length, "Index out of bounds");
+    _dyn_arr_ensure_capacity(dyn_arr, arr_length);
+    header = _dyn_arr_to_header(*dyn_arr);
+
+    void *end = (uint8_t*) (*dyn_arr) + (index+arr_length)*header->element_size;
+    void *dest = (uint8_t*) (*dyn_arr) + index*header->element_size;
+
+    memmove(end, dest, (header->length - index)*header->element_size);
+    if (arr == NULL) {
+        memset(dest, 0, arr_length*header->element_size);
+    } else {
+        memcpy(dest, arr, arr_length*header->element_size);
+    }
+
+    header->length += arr_length;
+}
+
+void dyn_arr_remove_arr(void** dyn_arr, size_t index, size_t count, void* output) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    core_assert_msg(index < header->length, "Index out of bounds");
+    core_assert_msg(index+count <= header->length, "Index out of bounds");
+
+    void *end = (uint8_t*) (*dyn_arr) + (index+count)*header->element_size;
+    void *dest = (uint8_t*) (*dyn_arr) + index*header->element_size;
+
+    if (output != NULL) {
+        memcpy(output, dest, count*header->element_size);
+    }
+    memmove(dest, end, (header->length - index - count)*header->element_size);
+
+    header->length -= count;
+}
+
+void dyn_arr_insert(void** dyn_arr, size_t index, const void* value) {
+    dyn_arr_insert_arr(dyn_arr, index, value, 1);
+}
+
+void dyn_arr_remove(void** dyn_arr, size_t index, void* output) {
+    dyn_arr_remove_arr(dyn_arr, index, 1, output); \
+}
+
+void dyn_arr_insert_fast(void** dyn_arr, size_t index, const void* value) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    core_assert_msg(index <= header->length, "Index out of bounds");
+    _dyn_arr_ensure_capacity(dyn_arr, 1);
+    header = _dyn_arr_to_header(*dyn_arr);
+
+    void *end = (uint8_t*) (*dyn_arr) + header->length*header->element_size;
+    void *dest = (uint8_t*) (*dyn_arr) + index*header->element_size;
+
+    memcpy(end, dest, header->element_size);
+    if (value == NULL) {
+        memset(dest, 0, header->element_size);
+    } else {
+        memcpy(dest, value, header->element_size);
+    }
+
+    header->length++;
+}
+
+void dyn_arr_remove_fast(void** dyn_arr, size_t index, void* output) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    core_assert_msg(index < header->length, "Index out of bounds");
+
+    void *end = (uint8_t*) (*dyn_arr) + (header->length-1)*header->element_size;
+    void *dest = (uint8_t*) (*dyn_arr) + index*header->element_size;
+
+    if (output != NULL) {
+        memcpy(output, dest, header->element_size);
+    }
+    memcpy(dest, end, header->element_size);
+
+    header->length--;
+}
+
+void dyn_arr_push(void** dyn_arr, const void* value) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    _dyn_arr_ensure_capacity(dyn_arr, 1);
+    header = _dyn_arr_to_header(*dyn_arr);
+
+    void *end = (uint8_t*) (*dyn_arr) + header->length*header->element_size;
+    memcpy(end, value, header->element_size);
+    header->length++;
+}
+
+void dyn_arr_pop(void** dyn_arr, void* output) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    core_assert_msg(header->length > 0, "Index out of bounds");
+
+    if (output != NULL) {
+        void *end = (uint8_t*) (*dyn_arr) + (header->length - 1)*header->element_size;
+        memcpy(output, end, header->element_size);
+    }
+    header->length--;
+}
+
+void dyn_arr_push_arr(void** dyn_arr, const void* arr, size_t arr_length) {
+    dyn_arr_insert_arr(dyn_arr, dyn_arr_length(*dyn_arr), arr, arr_length);
+}
+
+void dyn_arr_pop_arr(void** dyn_arr, size_t count, void* output) {
+    core_assert(count <= dyn_arr_length(*dyn_arr));
+    size_t index = dyn_arr_length(*dyn_arr) - count;
+    dyn_arr_remove_arr(dyn_arr, index, count, output);
+}
+
+size_t dyn_arr_remove_if(void** dyn_arr, dyn_arr_predicate_func_t predicate, void* userdata) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    uint8_t* data = *dyn_arr;
+    size_t element_size = header->element_size;
+    size_t length = header->length;
+
+    // Kept runs are moved once they end so the predicate sees every element
+    // exactly once and in its original place.
+    size_t write = 0;
+    size_t run = 0;
+    for (size_t read = 0; read <= length; read++) {
+        if (read < length && !predicate(&data[read*element_size], userdata)) {
+            continue;
+        }
+        if (write != run) {
+            memmove(&data[write*element_size], &data[run*element_size], (read - run)*element_size);
+        }
+        write += read - run;
+        run = read + 1;
+    }
+
+    header->length = write;
+    return length - write;
+}
+
+void dyn_arr_remove_indices(void** dyn_arr, const size_t* sorted_indices, size_t count) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    if (count == 0) {
+        return;
+    }
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    uint8_t* data = *dyn_arr;
+    size_t element_size = header->element_size;
+    core_assert_msg(sorted_indices[count - 1] < header->length, "Index out of bounds");
+
+    size_t write = sorted_indices[0];
+    for (size_t i = 0; i < count; i++) {
+        size_t run = sorted_indices[i] + 1;
+        size_t end = i + 1 < count ? sorted_indices[i + 1] : header->length;
+        core_assert_msg(run <= end, "Indices must be strictly increasing");
+        memmove(&data[write*element_size], &data[run*element_size], (end - run)*element_size);
+        write += end - run;
+    }
+
+    header->length = write;
+}
+
+size_t dyn_arr_dedup_sorted(void** dyn_arr, dyn_arr_compare_func_t compare, void* userdata) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    uint8_t* data = *dyn_arr;
+    size_t element_size = header->element_size;
+    size_t length = header->length;
+    if (length < 2) {
+        return 0;
+    }
+
+    // 'write' is one past the last kept element, which every unique run starts
+    // from when compared.
+    size_t write = 1;
+    size_t read = 1;
+    while (read < length) {
+        while (read < length && _dyn_arr_equal(&data[(write - 1)*element_size], &data[read*element_size], element_size, compare, userdata)) {
+            read++;
+        }
+        size_t run = read;
+        while (read < length && !_dyn_arr_equal(&data[(read - 1)*element_size], &data[read*element_size], element_size, compare, userdata)) {
+            read++;
+        }
+        if (write != run) {
+            memmove(&data[write*element_size], &data[run*element_size], (read - run)*element_size);
+        }
+        write += read - run;
+    }
+
+    header->length = write;
+    return length - write;
+}
+
+void dyn_arr_splice(void** dyn_arr, size_t index, size_t count, const void* arr, size_t arr_length) {
+    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
+    core_assert_msg(index <= header->length && count <= header->length - index, "Index out of bounds");
+    if (arr_length > count) {
+        _dyn_arr_ensure_capacity(dyn_arr, arr_length - count);
+        header = _dyn_arr_to_header(*dyn_arr);
+    }
+    uint8_t* data = *dyn_arr;
+    size_t element_size = header->element_size;
+
+    size_t tail = header->length - index - count;
+    memmove(&data[(index + arr_length)*element_size], &data[(index + count)*element_size], tail*element_size);
+    if (arr == NULL) {
+        memset(&data[index*element_size], 0, arr_length*element_size);
+    } else if (arr_length > 0) {
+        memcpy(&data[index*element_size], arr, arr_length*element_size);
+    }
+
+    header->length = header->length - count + arr_length;
+}
+
+#define _DYN_ARR_INSERTION_SORT_THRESHOLD 16
+
+static inline void _dyn_arr_swap(uint8_t* a, uint8_t* b, size_t size) {
+    switch (size) {
+    case 1: { uint8_t t = *a; *a = *b; *b = t; return; }
+    case 2: { uint16_t t; memcpy(&t, a, 2); memcpy(a, b, 2); memcpy(b, &t, 2); return; }
+    case 4: { uint32_t t; memcpy(&t, a, 4); memcpy(a, b, 4); memcpy(b, &t, 4); return; }
+    case 8: { uint64_t t; memcpy(&t, a, 8); memcpy(a, b, 8); memcpy(b, &t, 8); return; }
+    case 16: { uint64_t t[2]; memcpy(t, a, 16); memcpy(a, b, 16); memcpy(b, t, 16); return; }
+    default:
+        for (size_t i = 0; i < size; i++) {
+            uint8_t t = a[i];
+            a[i] = b[i];
+            b[i] = t;
+        }
+    }
+}
+
+static inline void _dyn_arr_copy(uint8_t* dst, const uint8_t* src, size_t size) {
+    switch (size) {
+    case 4: memcpy(dst, src, 4); return;
+    case 8: memcpy(dst, src, 8); return;
+    case 16: memcpy(dst, src, 16); return;
+    default: memcpy(dst, src, size);
+    }
+}
+
+static void _dyn_arr_insertion_sort(uint8_t* data, size_t count, size_t size, dyn_arr_compare_func_t compare, void* userdata) {
+    for (size_t i = 1; i < count; i++) {
+        for (size_t j = i; j > 0 && compare(&data[j*size], &data[(j - 1)*size], userdata) < 0; j--) {
+            _dyn_arr_swap(&data[j*size], &data[(j - 1)*size], size);
+        }
+    }
+}
+
+static void _dyn_arr_heap_sort(uint8_t* data, size_t count, size_t size, dyn_arr_compare_func_t compare, void* userdata) {
+    for (size_t end = count, i = count / 2; end > 1;) {
+        // Builds the heap while 'i' counts down, then pops the maximum.
+        if (i > 0) {
+            i--;
+        } else {
+            end--;
+            _dyn_arr_swap(&data[0], &data[end*size], size);
+        }
+        size_t parent = i;
+        while (true) {
+            size_t child = 2 * parent + 1;
+            if (child >= end) {
+                break;
+            }
+            if (child + 1 < end && compare(&data[child*size], &data[(child + 1)*size], userdata) < 0) {
+                child++;
+            }
+            if (compare(&data[parent*size], &data[child*size], userdata) >= 0) {
+                break;
+            }
+            _dyn_arr_swap(&data[parent*size], &data[child*size], size);
+            parent = child;
+        }
+    }
+}
+
+static void _dyn_arr_intro_sort(uint8_t* data, size_t count, size_t size, dyn_arr_compare_func_t compare, void* userdata, uint32_t depth) {
+    while (count > _DYN_ARR_INSERTION_SORT_THRESHOLD) {
+        if (depth == 0) {
+            _dyn_arr_heap_sort(data, count, size, compare, userdata);
+            return;
+        }
+        depth--;
+
+        // Orders the second, middle and last element and moves the median to
+        // the front, leaving a sentinel at either end for the scans below.
+        uint8_t* first = &data[size];
+        uint8_t* middle = &data[(count / 2)*size];
+        uint8_t* last = &data[(count - 1)*size];
+        if (compare(middle, first, userdata) < 0) {
+            _dyn_arr_swap(middle, first, size);
+        }
+        if (compare(last, middle, userdata) < 0) {
+            _dyn_arr_swap(last, middle, size);
+            if (compare(middle, first, userdata) < 0) {
+                _dyn_arr_swap(middle, first, size);
+            }
+        }
+        _dyn_arr_swap(data, middle, size);
+
+        // Both scans stop on elements equal to the pivot, which keeps runs of
+        // duplicates balanced.
+        size_t i = 1;
+        size_t j = count - 1;
+        while (true) {
+            do {
+                i++;
+            } while (compare(&data[i*size], data, userdata) < 0);
+            do {
+                j--;
+            } while (compare(data, &data[j*size], userdata) < 0);
+            if (i >= j) {
+                break;
+            }
+            _dyn_arr_swap(&data[i*size], &data[j*size], size);
+        }
+        _dyn_arr_swap(data, &data[j*size], size);
+
+        // Recurses into the smaller side so the stack stays logarithmic.
+        size_t left = j;
+        size_t right = count - j - 1;
+        if (left < right) {
+            _dyn_arr_intro_sort(data, left, size, compare, userdata, depth);
+            data = &data[(j + 1)*size];
+            count = right;
+        } else {
+            _dyn_arr_intro_sort(&data[(j + 1)*size], right, size, compare, userdata, depth);
+            count = left;
+        }
+    }
+    _dyn_arr_insertion_sort(data, count, size, compare, userdata);
+}
+
+static void _dyn_arr_sort_range(uint8_t* data, size_t count, size_t size, dyn_arr_compare_func_t compare, void* userdata) {
+    if (count > 1) {
+        _dyn_arr_intro_sort(data, count, size, compare, userdata, 2 * _log2_floor(count));
+    }
+}
+
+void dyn_arr_sort(void* dyn_arr, dyn_arr_compare_func_t compare, void* userdata) {
+    core_assert_msg(dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(dyn_arr);
+    _dyn_arr_sort_range(dyn_arr, header->length, header->element_size, compare, userdata);
+}
+
+typedef struct _dyn_arr_merge_sort_t _dyn_arr_merge_sort_t;
+struct _dyn_arr_merge_sort_t {
+    uint8_t* source;
+    uint8_t* destination;
+    size_t element_size;
+    size_t length;
+    // Length of the sorted runs, merged in pairs each round.
+    size_t run;
+    dyn_arr_compare_func_t compare;
+    void* userdata;
+};
+
+static void _dyn_arr_sort_runs(size_t begin, size_t end, void* data) {
+    _dyn_arr_merge_sort_t* sort = data;
+    for (size_t i = begin; i < end; i++) {
+        size_t start = i * sort->run;
+        size_t count = sort->length - start < sort->run ? sort->length - start : sort->run;
+        _dyn_arr_sort_range(&sort->source[start*sort->element_size], count, sort->element_size, sort->compare, sort->userdata);
+    }
+}
+
+// Number of elements taken from 'a' among the first 'k' of the merged output,
+// with ties going to 'a'.
+static size_t _dyn_arr_merge_split(const _dyn_arr_merge_sort_t* sort, const uint8_t* a, size_t a_count, const uint8_t* b, size_t b_count, size_t k) {
+    size_t size = sort->element_size;
+    size_t low = k > b_count ? k - b_count : 0;
+    size_t high = k < a_count ? k : a_count;
+    while (low < high) {
+        size_t i = low + (high - low) / 2;
+        size_t j = k - i;
+        if (j == 0 || sort->compare(&b[(j - 1)*size], &a[i*size], sort->userdata) < 0) {
+            high = i;
+        } else {
+            low = i + 1;
+        }
+    }
+    return low;
+}
+
+// Writes output elements [begin, end) of each pair of runs the range touches.
+static void _dyn_arr_merge_runs(size_t begin, size_t end, void* data) {
+    _dyn_arr_merge_sort_t* sort = data;
+    size_t size = sort->element_size;
+    while (begin < end) {
+        size_t pair = begin / (2 * sort->run) * (2 * sort->run);
+        size_t middle = pair + sort->run < sort->length ? pair + sort->run : sort->length;
+        size_t pair_end = middle + sort->run < sort->length ? middle + sort->run : sort->length;
+        size_t slice_end = end < pair_end ? end : pair_end;
+
+        const uint8_t* a = &sort->source[pair*size];
+        const uint8_t* b = &sort->source[middle*size];
+        size_t a_count = middle - pair;
+        size_t b_count = pair_end - middle;
+        size_t i = _dyn_arr_merge_split(sort, a, a_count, b, b_count, begin - pair);
+        size_t j = begin - pair - i;
+        size_t a_end = _dyn_arr_merge_split(sort, a, a_count, b, b_count, slice_end - pair);
+        size_t b_end = slice_end - pair - a_end;
+
+        uint8_t* output = &sort->destination[begin*size];
+        while (i < a_end && j < b_end) {
+            if (sort->compare(&b[j*size], &a[i*size], sort->userdata) < 0) {
+                _dyn_arr_copy(output, &b[j*size], size);
+                j++;
+            } else {
+                _dyn_arr_copy(output, &a[i*size], size);
+                i++;
+            }
+            output += size;
+        }
+        memcpy(output, &a[i*size], (a_end - i)*size);
+        output += (a_end - i)*size;
+        memcpy(output, &b[j*size], (b_end - j)*size);
+        begin = slice_end;
+    }
+}
+
+void dyn_arr_sort_parallel(void* dyn_arr, dyn_arr_compare_func_t compare, void* userdata) {
+    core_assert_msg(dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(dyn_arr);
+    size_t length = header->length;
+    size_t element_size = header->element_size;
+    uint32_t workers = job_system_worker_count();
+    if (length < DYN_ARR_PARALLEL_SORT_THRESHOLD || workers == 0) {
+        dyn_arr_sort(dyn_arr, compare, userdata);
+        return;
+    }
+
+    arena_scope_t scratch = scratch_begin(NULL, 0);
+    uint8_t* buffer = arena_push(scratch.arena, length * element_size);
+    bool owned = buffer == NULL;
+    if (owned) {
+        buffer = core_alloc(header->allocator, length * element_size);
+        core_assert_msg(buffer != NULL, "Failed to allocate the sort buffer");
+    }
+
+    // A few runs per thread so uneven chunks still balance.
+    size_t runs = 1;
+    while (runs < 4 * ((size_t) workers + 1)) {
+        runs *= 2;
+    }
+    _dyn_arr_merge_sort_t sort = {
+        .source = dyn_arr,
+        .destination = buffer,
+        .element_size = element_size,
+        .length = length,
+        .run = (length + runs - 1) / runs,
+        .compare = compare,
+        .userdata = userdata,
+    };
+    // Rounding the run up can leave trailing slots with nothing to sort.
+    runs = (length + sort.run - 1) / sort.run;
+    parallel_for(runs, 1, _dyn_arr_sort_runs, &sort);
+    while (sort.run < length) {
+        parallel_for(length, 4096, _dyn_arr_merge_runs, &sort);
+        uint8_t* source = sort.source;
+        sort.source = sort.destination;
+        sort.destination = source;
+        sort.run *= 2;
+    }
+    if (sort.source != dyn_arr) {
+        memcpy(dyn_arr, sort.source, length * element_size);
+    }
+
+    if (owned) {
+        core_free(header->allocator, buffer, length * element_size);
+    }
+    scratch_end(&scratch);
+}
+
+// Maps a key onto an unsigned integer with the same ordering.
+static inline uint64_t _dyn_arr_radix_key(const uint8_t* element, dyn_arr_key_type_t key_type) {
+    switch (key_type) {
+    case DYN_ARR_KEY_U32: { uint32_t v; memcpy(&v, element, 4); return v; }
+    case DYN_ARR_KEY_I32: { uint32_t v; memcpy(&v, element, 4); return v ^ 0x80000000u; }
+    case DYN_ARR_KEY_F32: { uint32_t v; memcpy(&v, element, 4); return v & 0x80000000u ? ~v : v | 0x80000000u; }
+    case DYN_ARR_KEY_U64: { uint64_t v; memcpy(&v, element, 8); return v; }
+    case DYN_ARR_KEY_I64: { uint64_t v; memcpy(&v, element, 8); return v ^ 0x8000000000000000ull; }
+    case DYN_ARR_KEY_F64: { uint64_t v; memcpy(&v, element, 8); return v & 0x8000000000000000ull ? ~v : v | 0x8000000000000000ull; }
+    }
+    return 0;
+}
+
+void dyn_arr_radix_sort(void* dyn_arr, dyn_arr_key_type_t key_type, size_t key_offset) {
+    core_assert_msg(dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(dyn_arr);
+    size_t length = header->length;
+    size_t size = header->element_size;
+    uint32_t key_bytes = key_type == DYN_ARR_KEY_U32 || key_type == DYN_ARR_KEY_I32 || key_type == DYN_ARR_KEY_F32 ? 4 : 8;
+    core_assert_msg(key_offset + key_bytes <= size, "Key outside of the element");
+    if (length < 2) {
+        return;
+    }
+
+    arena_scope_t scratch = scratch_begin(NULL, 0);
+    size_t (*counts)[256] = arena_push(scratch.arena, sizeof(size_t) * 256 * key_bytes);
+    core_assert_msg(counts != NULL, "Failed to allocate the sort histograms");
+    memset(counts, 0, sizeof(size_t) * 256 * key_bytes);
+    uint8_t* buffer = arena_push(scratch.arena, length * size);
+    bool owned = buffer == NULL;
+    if (owned) {
+        buffer = core_alloc(header->allocator, length * size);
+        core_assert_msg(buffer != NULL, "Failed to allocate the sort buffer");
+    }
+
+    // Every byte's histogram comes from a single read of the keys.
+    uint8_t* source = dyn_arr;
+    for (size_t i = 0; i < length; i++) {
+        uint64_t key = _dyn_arr_radix_key(&source[i*size + key_offset], key_type);
+        for (uint32_t b = 0; b < key_bytes; b++) {
+            counts[b][(key >> (8 * b)) & 0xFF]++;
+        }
+    }
+
+    uint8_t* destination = buffer;
+    uint64_t first_key = _dyn_arr_radix_key(&source[key_offset], key_type);
+    for (uint32_t b = 0; b < key_bytes; b++) {
+        if (counts[b][(first_key >> (8 * b)) & 0xFF] == length) {
+            continue;
+        }
+        size_t offset = 0;
+        for (uint32_t digit = 0; digit < 256; digit++) {
+            size_t count = counts[b][digit];
+            counts[b][digit] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < length; i++) {
+            const uint8_t* element = &source[i*size];
+            uint64_t key = _dyn_arr_radix_key(&element[key_offset], key_type);
+            _dyn_arr_copy(&destination[counts[b][(key >> (8 * b)) & 0xFF]++ * size], element, size);
+        }
+        uint8_t* swap = source;
+        source = destination;
+        destination = swap;
+    }
+    if (source != dyn_arr) {
+        memcpy(dyn_arr, source, length * size);
+    }
+
+    if (owned) {
+        core_free(header->allocator, buffer, length * size);
+    }
+    scratch_end(&scratch);
+}
+
+size_t dyn_arr_lower_bound(const void* dyn_arr, const void* key, dyn_arr_compare_func_t compare, void* userdata) {
+    core_assert_msg(dyn_arr != NULL, "Null pointer dereference");
+    _dyn_arr_header_t* header = _dyn_arr_to_header(dyn_arr);
+    const uint8_t* data = dyn_arr;
+    size_t size = header->element_size;
+    size_t low = 0;
+    size_t count = header->length;
+    while (count > 0) {
+        size_t half = count / 2;
+        if (compare(&data[(low + half)*size], key, userdata) < 0) {
+            low += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return low;
+}
+
+size_t dyn_arr_binary_search(const void* dyn_arr, const void* key, dyn_arr_compare_func_t compare, void* userdata) {
+    _dyn_arr_header_t* header = _dyn_arr_to_header(dyn_arr);
+    const uint8_t* data = dyn_arr;
+    size_t index = dyn_arr_lower_bound(dyn_arr, key, compare, userdata);
+    if (index < header->length && compare(&data[index*header->element_size], key, userdata) == 0) {
+        return index;
+    }
+    return DYN_ARR_NOT_FOUND;
+}
+
+// =============================================================================
+// SOA ARRAY
+// =============================================================================
+
+// Lays the columns out for 'capacity' rows and returns the allocation size,
+// which includes room to align the first column.
+static size_t _soa_arr_layout(const soa_arr_t* arr, size_t capacity, size_t* offsets) {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < arr->column_count; i++) {
+        offset = _align_up(offset, SOA_ARR_COLUMN_ALIGN);
+        offsets[i] = offset;
+        offset += arr->column_sizes[i] * capacity;
+    }
+    return offset + SOA_ARR_COLUMN_ALIGN;
+}
+
+static void _soa_arr_set_capacity(soa_arr_t* arr, size_t capacity) {
+    size_t offsets[SOA_ARR_MAX_COLUMNS];
+    size_t allocation_size = _soa_arr_layout(arr, capacity, offsets);
+    uint8_t* memory = core_alloc(arr->allocator, allocation_size);
+    core_assert_msg(memory != NULL, "Failed to grow the array");
+    uint8_t* base = (uint8_t*) _align_up((uintptr_t) memory, SOA_ARR_COLUMN_ALIGN);
+    for (uint32_t i = 0; i < arr->column_count; i++) {
+        uint8_t* column = base + offsets[i];
+        if (arr->length > 0) {
+            memcpy(column, arr->columns[i], arr->column_sizes[i] * arr->length);
+        }
+        arr->columns[i] = column;
+    }
+    if (arr->memory != NULL) {
+        core_free(arr->allocator, arr->memory, arr->allocation_size);
+    }
+    arr->memory = memory;
+    arr->allocation_size = allocation_size;
+    arr->capacity = capacity;
+}
+
+soa_arr_t* soa_arr_create(allocator_t allocator, const size_t* column_sizes, uint32_t column_count) {
+    core_assert_msg(column_count > 0 && column_count <= SOA_ARR_MAX_COLUMNS, "Column count must be between 1 and %d", SOA_ARR_MAX_COLUMNS);
+    soa_arr_t* arr = core_alloc(allocator, sizeof(soa_arr_t));
+    if (arr == NULL) {
+        return NULL;
+    }
+    *arr = (soa_arr_t) {
+        .allocator = allocator,
+        .growth_factor = DYN_ARR_DEFAULT_GROWTH_FACTOR,
+        .column_count = column_count,
+    };
+    for (uint32_t i = 0; i < column_count; i++) {
+        core_assert_msg(column_sizes[i] > 0, "Column size must be greater than 0");
+        arr->column_sizes[i] = column_sizes[i];
+    }
+    return arr;
+}
+
+void soa_arr_destroy(soa_arr_t** arr) {
+    soa_arr_t* a = *arr;
+    if (a->memory != NULL) {
+        core_free(a->allocator, a->memory, a->allocation_size);
+    }
+    core_free(a->allocator, a, sizeof(soa_arr_t));
+    *arr = NULL;
+}
+
+size_t soa_arr_length(const soa_arr_t* arr) {
+    return arr->length;
+}
+
+size_t soa_arr_capacity(const soa_arr_t* arr) {
+    return arr->capacity;
+}
+
+void soa_arr_clear(soa_arr_t* arr) {
+    arr->length = 0;
+}
+
+void soa_arr_reserve(soa_arr_t* arr, size_t capacity) {
+    if (arr->capacity < capacity) {
+        _soa_arr_set_capacity(arr, capacity);
+    }
+}
+
+void soa_arr_set_growth_factor(soa_arr_t* arr, float growth_factor) {
+    core_assert_msg(growth_factor > 1.0f, "Growth factor must be greater than 1");
+    arr->growth_factor = growth_factor;
+}
+
+size_t soa_arr_push(soa_arr_t* arr, const void* const* values) {
+    if (arr->length == arr->capacity) {
+        size_t capacity = (size_t) (arr->capacity * arr->growth_factor);
+        if (capacity < _DYN_ARR_INITIAL_SIZE) {
+            capacity = _DYN_ARR_INITIAL_SIZE;
+        }
+        if (capacity <= arr->length) {
+            capacity = arr->length + 1;
+        }
+        _soa_arr_set_capacity(arr, capacity);
+    }
+    size_t index = arr->length;
+    for (uint32_t i = 0; i < arr->column_count; i++) {
+        size_t size = arr->column_sizes[i];
+        uint8_t* field = arr->columns[i] + index * size;
+        if (values != NULL && values[i] != NULL) {
+            memcpy(field, values[i], size);
+        } else {
+            memset(field, 0, size);
+        }
+    }
+    arr->length++;
+    return index;
+}
+
+void soa_arr_remove_fast(soa_arr_t* arr, size_t index) {
+    core_assert_msg(index < arr->length, "Index out of bounds");
+    size_t last = arr->length - 1;
+    if (index != last) {
+        for (uint32_t i = 0; i < arr->column_count; i++) {
+            size_t size = arr->column_sizes[i];
+            memcpy(arr->columns[i] + index * size, arr->columns[i] + last * size, size);
+        }
+    }
+    arr->length = last;
+}
+
+void soa_arr_pop(soa_arr_t* arr) {
+    core_assert_msg(arr->length > 0, "Index out of bounds");
+    arr->length--;
+}
+
+// =============================================================================
+// SEGMENTED ARRAY
+// =============================================================================
+
+// Chunk k holds first << k elements, so shifting the index by the first
+// chunk's capacity makes the position of its top bit the chunk number.
+static inline void _seg_arr_locate(const seg_arr_t* arr, size_t index, uint32_t* chunk, size_t* offset) {
+    size_t shifted = index + ((size_t) 1 << arr->first_chunk_log2);
+    uint32_t top = _log2_floor(shifted);
+    *chunk = top - arr->first_chunk_log2;
+    *offset = shifted - ((size_t) 1 << top);
+}
+
+static size_t _seg_arr_chunk_capacity(const seg_arr_t* arr, uint32_t chunk) {
+    return (size_t) 1 << (arr->first_chunk_log2 + chunk);
+}
+
+// Returns the chunk, allocating it if no one else has yet.
+static uint8_t* _seg_arr_chunk(seg_arr_t* arr, uint32_t chunk) {
+    core_assert_msg(chunk < SEG_ARR_MAX_CHUNKS, "Segmented array is full");
+    uint8_t* memory = atomic_load_explicit(&arr->chunks[chunk], memory_order_acquire);
+    if (memory != NULL) {
+        return memory;
+    }
+    size_t size = _seg_arr_chunk_capacity(arr, chunk) * arr->element_size;
+    uint8_t* fresh = core_alloc(arr->allocator, size);
+    core_assert_msg(fresh != NULL, "Failed to allocate a chunk");
+    if (!atomic_compare_exchange_strong_explicit(&arr->chunks[chunk], &memory, fresh, memory_order_acq_rel, memory_order_acquire)) {
+        core_free(arr->allocator, fresh, size);
+        return memory;
+    }
+    return fresh;
+}
+
+seg_arr_t* seg_arr_create(allocator_t allocator, size_t element_size, size_t first_chunk) {
+    core_assert_msg(element_size > 0, "Element size must be greater than 0");
+    if (first_chunk == 0) {
+        first_chunk = SEG_ARR_DEFAULT_FIRST_CHUNK;
+    }
+    core_assert_msg(_is_power_of_two(first_chunk), "First chunk capacity must be a power of two");
+    seg_arr_t* arr = core_alloc(allocator, sizeof(seg_arr_t));
+    if (arr == NULL) {
+        return NULL;
+    }
+    *arr = (seg_arr_t) {
+        .allocator = allocator,
+        .element_size = element_size,
+        .first_chunk_log2 = _log2_floor(first_chunk),
+    };
+    for (uint32_t i = 0; i < SEG_ARR_MAX_CHUNKS; i++) {
+        atomic_init(&arr->chunks[i], NULL);
+    }
+    atomic_init(&arr->reserved, 0);
+    atomic_init(&arr->length, 0);
+    return arr;
+}
+
+void seg_arr_destroy(seg_arr_t** arr) {
+    seg_arr_t* a = *arr;
+    for (uint32_t i = 0; i < SEG_ARR_MAX_CHUNKS; i++) {
+        uint8_t* chunk = atomic_load_explicit(&a->chunks[i], memory_order_relaxed);
+        if (chunk != NULL) {
+            core_free(a->allocator, chunk, _seg_arr_chunk_capacity(a, i) * a->element_size);
+        }
+    }
+    core_free(a->allocator, a, sizeof(seg_arr_t));
+    *arr = NULL;
+}
+
+size_t seg_arr_length(const seg_arr_t* arr) {
+    return atomic_load_explicit(&((seg_arr_t*) arr)->length, memory_order_acquire);
+}
+
+void seg_arr_clear(seg_arr_t* arr) {
+    atomic_store_explicit(&arr->reserved, 0, memory_order_relaxed);
+    atomic_store_explicit(&arr->length, 0, memory_order_relaxed);
+}
+
+static void _seg_arr_store(seg_arr_t* arr, uint8_t* element, const void* value) {
+    if (value != NULL) {
+        memcpy(element, value, arr->element_size);
+    } else {
+        memset(element, 0, arr->element_size);
+    }
+}
+
+void* seg_arr_push(seg_arr_t* arr, const void* value) {
+    size_t index = atomic_load_explicit(&arr->length, memory_order_relaxed);
+    uint32_t chunk;
+    size_t offset;
+    _seg_arr_locate(arr, index, &chunk, &offset);
+    uint8_t* element = _seg_arr_chunk(arr, chunk) + offset * arr->element_size;
+    _seg_arr_store(arr, element, value);
+    atomic_store_explicit(&arr->reserved, index + 1, memory_order_relaxed);
+    atomic_store_explicit(&arr->length, index + 1, memory_order_release);
+    return element;
+}
+
+void* seg_arr_push_concurrent(seg_arr_t* arr, const void* value) {
+    size_t index = atomic_fetch_add_explicit(&arr->reserved, 1, memory_order_relaxed);
+    uint32_t chunk;
+    size_t offset;
+    _seg_arr_locate(arr, index, &chunk, &offset);
+    uint8_t* element = _seg_arr_chunk(arr, chunk) + offset * arr->element_size;
+    _seg_arr_store(arr, element, value);
+
+    // Publishes after every earlier index, so readers never see a gap. Those
+    // appenders are already past their fetch-add and only have a copy left.
+    size_t expected = index;
+    while (!atomic_compare_exchange_weak_explicit(&arr->length, &expected, index + 1, memory_order_release, memory_order_relaxed)) {
+        expected = index;
+        _os_yield();
+    }
+    return element;
+}
+
+void* seg_arr_get(const seg_arr_t* arr, size_t index) {
+    core_assert_msg(index < seg_arr_length(arr), "Index out of bounds");
+    uint32_t chunk;
+    size_t offset;
+    _seg_arr_locate(arr, index, &chunk, &offset);
+    return atomic_load_explicit(&((seg_arr_t*) arr)->chunks[chunk], memory_order_relaxed) + offset * arr->element_size;
+}
+
+void* seg_arr_span(const seg_arr_t* arr, size_t index, size_t* count) {
+    size_t length = seg_arr_length(arr);
+    core_assert_msg(index < length, "Index out of bounds");
+    uint32_t chunk;
+    size_t offset;
+    _seg_arr_locate(arr, index, &chunk, &offset);
+    size_t available = _seg_arr_chunk_capacity(arr, chunk) - offset;
+    *count = available < length - index ? available : length - index;
+    return atomic_load_explicit(&((seg_arr_t*) arr)->chunks[chunk], memory_order_relaxed) + offset * arr->element_size;
+}
+
+// =============================================================================
+// SLOT MAP
+// =============================================================================
+
+#define _SLOT_MAP_INDEX_MASK (((slot_handle_t) 1 << SLOT_MAP_INDEX_BITS) - 1)
+#define _SLOT_MAP_GENERATION_MASK ((uint32_t) ((slot_handle_t) -1 >> SLOT_MAP_INDEX_BITS))
+#define _SLOT_MAP_NO_SLOT UINT32_MAX
+
+static slot_handle_t _slot_map_handle(uint32_t slot, uint32_t generation) {
+    return (slot_handle_t) generation << SLOT_MAP_INDEX_BITS | slot;
+}
+
+// Returns the slot the handle refers to, or NULL if it is stale.
+static _slot_map_slot_t* _slot_map_lookup(const slot_map_t* map, slot_handle_t handle) {
+    size_t slot = (size_t) (handle & _SLOT_MAP_INDEX_MASK);
+    uint32_t generation = (uint32_t) (handle >> SLOT_MAP_INDEX_BITS);
+    if (slot >= dyn_arr_length(map->slots) || map->slots[slot].generation != generation || !(generation & 1)) {
+        return NULL;
+    }
+    return &map->slots[slot];
+}
+
+slot_map_t* slot_map_create(allocator_t allocator, size_t element_size) {
+    core_assert_msg(element_size > 0, "Element size must be greater than 0");
+    slot_map_t* map = core_alloc(allocator, sizeof(slot_map_t));
+    if (map == NULL) {
+        return NULL;
+    }
+    *map = (slot_map_t) {
+        .allocator = allocator,
+        .element_size = element_size,
+        .values = dyn_arr_create(allocator, element_size),
+        .dense_slots = dyn_arr_create(allocator, sizeof(uint32_t)),
+        .slots = dyn_arr_create(allocator, sizeof(_slot_map_slot_t)),
+        .free_head = _SLOT_MAP_NO_SLOT,
+    };
+    return map;
+}
+
+void slot_map_destroy(slot_map_t** map) {
+    slot_map_t* m = *map;
+    dyn_arr_destroy(&m->values);
+    dyn_arr_destroy((void**) &m->dense_slots);
+    dyn_arr_destroy((void**) &m->slots);
+    core_free(m->allocator, m, sizeof(slot_map_t));
+    *map = NULL;
+}
+
+size_t slot_map_length(const slot_map_t* map) {
+    return dyn_arr_length(map->values);
+}
+
+void slot_map_clear(slot_map_t* map) {
+    size_t length = dyn_arr_length(map->dense_slots);
+    for (size_t i = length; i > 0; i--) {
+        slot_map_remove(map, _slot_map_handle(map->dense_slots[i - 1], map->slots[map->dense_slots[i - 1]].generation), NULL);
+    }
+}
+
+slot_handle_t slot_map_insert(slot_map_t* map, const void* value) {
+    uint32_t slot = map->free_head;
+    if (slot == _SLOT_MAP_NO_SLOT) {
+        size_t count = dyn_arr_length(map->slots);
+        core_assert_msg(count < _SLOT_MAP_INDEX_MASK, "Slot map is full");
+        slot = (uint32_t) count;
+        dyn_arr_push_t(map->slots, ((_slot_map_slot_t) {0}));
+    } else {
+        map->free_head = map->slots[slot].index;
+    }
+
+    uint32_t dense_index = (uint32_t) dyn_arr_length(map->values);
+    if (value != NULL) {
+        dyn_arr_push(&map->values, value);
+    } else {
+        dyn_arr_splice(&map->values, dense_index, 0, NULL, 1);
+    }
+    dyn_arr_push_t(map->dense_slots, slot);
+
+    _slot_map_slot_t* entry = &map->slots[slot];
+    entry->index = dense_index;
+    entry->generation++;
+    return _slot_map_handle(slot, entry->generation);
+}
+
+void* slot_map_get(const slot_map_t* map, slot_handle_t handle) {
+    _slot_map_slot_t* entry = _slot_map_lookup(map, handle);
+    if (entry == NULL) {
+        return NULL;
+    }
+    return (uint8_t*) map->values + (size_t) entry->index * map->element_size;
+}
+
+bool slot_map_contains(const slot_map_t* map, slot_handle_t handle) {
+    return _slot_map_lookup(map, handle) != NULL;
+}
+
+bool slot_map_remove(slot_map_t* map, slot_handle_t handle, void* output) {
+    _slot_map_slot_t* entry = _slot_map_lookup(map, handle);
+    if (entry == NULL) {
+        return false;
+    }
+    uint32_t dense_index = entry->index;
+    uint32_t last = (uint32_t) dyn_arr_length(map->values) - 1;
+    dyn_arr_remove_fast(&map->values, dense_index, output);
+    dyn_arr_remove_fast((void**) &map->dense_slots, dense_index, NULL);
+    if (dense_index != last) {
+        map->slots[map->dense_slots[dense_index]].index = dense_index;
+    }
+
+    uint32_t slot = (uint32_t) (handle & _SLOT_MAP_INDEX_MASK);
+    entry->generation = (entry->generation + 1) & _SLOT_MAP_GENERATION_MASK;
+    if (entry->generation != 0) {
+        entry->index = map->free_head;
+        map->free_head = slot;
+    }
+    return true;
+}
+
+void* slot_map_values(const slot_map_t* map) {
+    return map->values;
+}
+
+slot_handle_t slot_map_handle_at(const slot_map_t* map, size_t dense_index) {
+    uint32_t slot = dyn_arr_get_t(map->dense_slots, dense_index);
+    return _slot_map_handle(slot, map->slots[slot].generation);
+}
+
+// =============================================================================
+// HASH MAP
+// =============================================================================
+
+// Full slots store the low 7 bits of the hash, so only empty and deleted
+// slots have the high bit set.
+#define _HASH_MAP_EMPTY 0x80
+#define _HASH_MAP_DELETED 0xFE
+#define _HASH_MAP_MIN_CAPACITY 16
+
+// A group is the window of control bytes compared at once. Matches come back
+// as a mask with _HASH_MAP_MASK_STRIDE bits per control byte, lowest first.
+#if defined(_HASH_MAP_SSE2)
+
+#define _HASH_MAP_GROUP_WIDTH 16
+#define _HASH_MAP_MASK_STRIDE 1
+
+typedef __m128i _hash_map_group_t;
+
+static inline _hash_map_group_t _hash_map_group_load(const uint8_t* ctrl) {
+    return _mm_loadu_si128((const __m128i*) ctrl);
+}
+
+static inline uint64_t _hash_map_group_match(_hash_map_group_t group, uint8_t h2) {
+    return (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char) h2)));
+}
+
+static inline uint64_t _hash_map_group_match_empty(_hash_map_group_t group) {
+    return _hash_map_group_match(group, _HASH_MAP_EMPTY);
+}
+
+static inline uint64_t _hash_map_group_match_empty_or_deleted(_hash_map_group_t group) {
+    return (uint64_t) _mm_movemask_epi8(group);
+}
+
+#elif defined(_HASH_MAP_NEON)
+
+#define _HASH_MAP_GROUP_WIDTH 8
+#define _HASH_MAP_MASK_STRIDE 8
+
+typedef uint8x8_t _hash_map_group_t;
+
+static inline _hash_map_group_t _hash_map_group_load(const uint8_t* ctrl) {
+    return vld1_u8(ctrl);
+}
+
+static inline uint64_t _hash_map_group_match(_hash_map_group_t group, uint8_t h2) {
+    return vget_lane_u64(vreinterpret_u64_u8(vceq_u8(group, vdup_n_u8(h2))), 0) & 0x8080808080808080ull;
+}
+
+static inline uint64_t _hash_map_group_match_empty(_hash_map_group_t group) {
+    return _hash_map_group_match(group, _HASH_MAP_EMPTY);
+}
+
+static inline uint64_t _hash_map_group_match_empty_or_deleted(_hash_map_group_t group) {
+    return vget_lane_u64(vreinterpret_u64_u8(group), 0) & 0x8080808080808080ull;
+}
+
+#else
+
+#define _HASH_MAP_GROUP_WIDTH 8
+#define _HASH_MAP_MASK_STRIDE 8
+
+typedef uint64_t _hash_map_group_t;
+
+#define _HASH_MAP_LSBS 0x0101010101010101ull
+#define _HASH_MAP_MSBS 0x8080808080808080ull
+
+static inline _hash_map_group_t _hash_map_group_load(const uint8_t* ctrl) {
+    uint64_t group;
+    memcpy(&group, ctrl, sizeof(group));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    group = __builtin_bswap64(group);
+#endif
+    return group;
+}
+
+// May report false positives next to a real match, which the key comparison
+// filters out.
+static inline uint64_t _hash_map_group_match(_hash_map_group_t group, uint8_t h2) {
+    uint64_t x = group ^ (_HASH_MAP_LSBS * h2);
+    return (x - _HASH_MAP_LSBS) & ~x & _HASH_MAP_MSBS;
+}
+
+// Empty is the only control byte with the high bit set and bit 1 clear.
+static inline uint64_t _hash_map_group_match_empty(_hash_map_group_t group) {
+    return group & ~(group << 6) & _HASH_MAP_MSBS;
+}
+
+static inline uint64_t _hash_map_group_match_empty_or_deleted(_hash_map_group_t group) {
+    return group & _HASH_MAP_MSBS;
+}
+
+#endif
+
+static inline size_t _hash_map_mask_first(uint64_t mask) {
+    return _count_trailing_zeros(mask) / _HASH_MAP_MASK_STRIDE;
+}
+
+// Number of control bytes before the first match, from either end.
+static inline size_t _hash_map_mask_leading(uint64_t mask) {
+    if (mask == 0) {
+        return _HASH_MAP_GROUP_WIDTH;
+    }
+    uint32_t unused_bits = 64 - _HASH_MAP_GROUP_WIDTH * _HASH_MAP_MASK_STRIDE;
+    return (63 - _log2_floor(mask) - unused_bits) / _HASH_MAP_MASK_STRIDE;
+}
+
+static inline size_t _hash_map_mask_trailing(uint64_t mask) {
+    return mask == 0 ? _HASH_MAP_GROUP_WIDTH : _hash_map_mask_first(mask);
+}
+
+uint64_t hash_bytes(const void* data, size_t size) {
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const uint8_t* bytes = data;
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ (size * m);
+    while (size >= 8) {
+        uint64_t k;
+        memcpy(&k, bytes, sizeof(k));
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        hash = (hash ^ k) * m;
+        bytes += 8;
+        size -= 8;
+    }
+    if (size > 0) {
+        uint64_t k = 0;
+        memcpy(&k, bytes, size);
+        hash = (hash ^ k) * m;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static inline uint64_t _hash_map_hash(const hash_map_t* map, const void* key) {
+    return map->hash == NULL ? hash_bytes(key, map->key_size) : map->hash(key, map->key_size);
+}
+
+static inline bool _hash_map_eq(const hash_map_t* map, const void* a, const void* b) {
+    return map->eq == NULL ? memcmp(a, b, map->key_size) == 0 : map->eq(a, b, map->key_size);
+}
+
+static inline uint8_t* _hash_map_slot(const hash_map_t* map, size_t index) {
+    return &map->slots[index * map->slot_size];
+}
+
+// The first group is mirrored past the end of the control bytes so that
+// unaligned group loads near the end wrap around for free.
+static inline void _hash_map_set_ctrl(hash_map_t* map, size_t index, uint8_t value) {
+    map->ctrl[index] = value;
+    map->ctrl[((index - _HASH_MAP_GROUP_WIDTH) & (map->capacity - 1)) + _HASH_MAP_GROUP_WIDTH] = value;
+}
+
+static inline size_t _hash_map_growth(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+static size_t _hash_map_allocation_size(const hash_map_t* map, size_t capacity) {
+    return capacity * map->slot_size + capacity + _HASH_MAP_GROUP_WIDTH;
+}
+
+// Natural alignment of a type is the largest power of two dividing its size.
+hash_map_t* hash_map_create(allocator_t allocator, size_t key_size, size_t value_size, hash_map_hash_func_t hash, hash_map_eq_func_t eq) {
+    core_assert_msg(key_size > 0, "Key size must be greater than 0");
+    size_t key_align = _natural_alignment(key_size);
+    size_t value_align = value_size == 0 ? 1 : _natural_alignment(value_size);
+    size_t value_offset = _align_up(key_size, value_align);
+    hash_map_t* map = core_alloc(allocator, sizeof(hash_map_t));
+    *map = (hash_map_t) {
+        .allocator = allocator,
+        .key_size = key_size,
+        .value_size = value_size,
+        .value_offset = value_offset,
+        .slot_size = _align_up(value_offset + value_size, key_align > value_align ? key_align : value_align),
+        .hash = hash,
+        .eq = eq,
+    };
+    return map;
+}
+
+void hash_map_destroy(hash_map_t** map) {
+    hash_map_t* m = *map;
+    if (m->slots != NULL) {
+        core_free(m->allocator, m->slots, _hash_map_allocation_size(m, m->capacity));
+    }
+    core_free(m->allocator, m, sizeof(hash_map_t));
+    *map = NULL;
+}
+
+size_t hash_map_length(const hash_map_t* map) {
+    return map->length;
+}
+
+void hash_map_clear(hash_map_t* map) {
+    if (map->capacity == 0) {
+        return;
+    }
+    memset(map->ctrl, _HASH_MAP_EMPTY, map->capacity + _HASH_MAP_GROUP_WIDTH);
+    map->length = 0;
+    map->growth_left = _hash_map_growth(map->capacity);
+}
+
+static size_t _hash_map_find(const hash_map_t* map, const void* key, uint64_t hash) {
+    size_t mask = map->capacity - 1;
+    uint8_t h2 = hash & 0x7F;
+    size_t position = (hash >> 7) & mask;
+    size_t stride = 0;
+    while (true) {
+        _hash_map_group_t group = _hash_map_group_load(&map->ctrl[position]);
+        uint64_t matches = _hash_map_group_match(group, h2);
+        while (matches != 0) {
+            size_t index = (position + _hash_map_mask_first(matches)) & mask;
+            if (_hash_map_eq(map, _hash_map_slot(map, index), key)) {
+                return index;
+            }
+            matches &= matches - 1;
+        }
+        if (_hash_map_group_match_empty(group) != 0) {
+            return SIZE_MAX;
+        }
+        // Triangular probing visits every group once for power of two capacities.
+        stride += _HASH_MAP_GROUP_WIDTH;
+        position = (position + stride) & mask;
+    }
+}
+
+static size_t _hash_map_find_free(const hash_map_t* map, uint64_t hash) {
+    size_t mask = map->capacity - 1;
+    size_t position = (hash >> 7) & mask;
+    size_t stride = 0;
+    while (true) {
+        uint64_t free_slots = _hash_map_group_match_empty_or_deleted(_hash_map_group_load(&map->ctrl[position]));
+        if (free_slots != 0) {
+            return (position + _hash_map_mask_first(free_slots)) & mask;
+        }
+        stride += _HASH_MAP_GROUP_WIDTH;
+        position = (position + stride) & mask;
+    }
+}
+
+static void _hash_map_resize(hash_map_t* map, size_t capacity) {
+    uint8_t* old_slots = map->slots;
+    uint8_t* old_ctrl = map->ctrl;
+    size_t old_capacity = map->capacity;
+
+    map->slots = core_alloc(map->allocator, _hash_map_allocation_size(map, capacity));
+    map->ctrl = &map->slots[capacity * map->slot_size];
+    map->capacity = capacity;
+    memset(map->ctrl, _HASH_MAP_EMPTY, capacity + _HASH_MAP_GROUP_WIDTH);
+    map->growth_left = _hash_map_growth(capacity) - map->length;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_ctrl[i] & 0x80) {
+            continue;
+        }
+        uint8_t* slot = &old_slots[i * map->slot_size];
+        uint64_t hash = _hash_map_hash(map, slot);
+        size_t index = _hash_map_find_free(map, hash);
+        _hash_map_set_ctrl(map, index, hash & 0x7F);
+        memcpy(_hash_map_slot(map, index), slot, map->slot_size);
+    }
+    if (old_slots != NULL) {
+        core_free(map->allocator, old_slots, _hash_map_allocation_size(map, old_capacity));
+    }
+}
+
+void hash_map_reserve(hash_map_t* map, size_t count) {
+    size_t capacity = map->capacity == 0 ? _HASH_MAP_MIN_CAPACITY : map->capacity;
+    while (_hash_map_growth(capacity) < count) {
+        capacity *= 2;
+    }
+    if (capacity != map->capacity) {
+        _hash_map_resize(map, capacity);
+    }
+}
+
+void* hash_map_get(const hash_map_t* map, const void* key) {
+    if (map->length == 0) {
+        return NULL;
+    }
+    size_t index = _hash_map_find(map, key, _hash_map_hash(map, key));
+    if (index == SIZE_MAX) {
+        return NULL;
+    }
+    return _hash_map_slot(map, index) + map->value_offset;
+}
+
+bool hash_map_contains(const hash_map_t* map, const void* key) {
+    return hash_map_get(map, key) != NULL;
+}
+
+void* hash_map_insert(hash_map_t* map, const void* key, const void* value) {
+    uint64_t hash = _hash_map_hash(map, key);
+    size_t index = map->length == 0 ? SIZE_MAX : _hash_map_find(map, key, hash);
+    if (index == SIZE_MAX) {
+        if (map->growth_left == 0) {
+            // Rehash in place when deleted slots take up most of the load.
+            size_t capacity = map->capacity;
+            if (capacity == 0) {
+                capacity = _HASH_MAP_MIN_CAPACITY;
+            } else if (map->length >= _hash_map_growth(capacity) / 2) {
+                capacity *= 2;
+            }
+            _hash_map_resize(map, capacity);
+        }
+        index = _hash_map_find_free(map, hash);
+        if (map->ctrl[index] == _HASH_MAP_EMPTY) {
+            map->growth_left--;
+        }
+        _hash_map_set_ctrl(map, index, hash & 0x7F);
+        memcpy(_hash_map_slot(map, index), key, map->key_size);
+        if (value == NULL) {
+            memset(_hash_map_slot(map, index) + map->value_offset, 0, map->value_size);
+        }
+        map->length++;
+    }
+    uint8_t* slot_value = _hash_map_slot(map, index) + map->value_offset;
+    if (value != NULL) {
+        memcpy(slot_value, value, map->value_size);
+    }
+    return slot_value;
+}
+
+bool hash_map_remove(hash_map_t* map, const void* key, void* output) {
+    if (map->length == 0) {
+        return false;
+    }
+    size_t index = _hash_map_find(map, key, _hash_map_hash(map, key));
+    if (index == SIZE_MAX) {
+        return false;
+    }
+    if (output != NULL) {
+        memcpy(output, _hash_map_slot(map, index) + map->value_offset, map->value_size);
+    }
+
+    // The slot can go straight back to empty if no probe sequence could have
+    // seen a full group across it, otherwise lookups must keep probing past it.
+    size_t mask = map->capacity - 1;
+    uint64_t empty_before = _hash_map_group_match_empty(_hash_map_group_load(&map->ctrl[(index - _HASH_MAP_GROUP_WIDTH) & mask]));
+    uint64_t empty_after = _hash_map_group_match_empty(_hash_map_group_load(&map->ctrl[index]));
+    bool was_never_full = empty_before != 0 && empty_after != 0 &&
+        _hash_map_mask_trailing(empty_after) + _hash_map_mask_leading(empty_before) < _HASH_MAP_GROUP_WIDTH;
+    if (was_never_full) {
+        _hash_map_set_ctrl(map, index, _HASH_MAP_EMPTY);
+        map->growth_left++;
+    } else {
+        _hash_map_set_ctrl(map, index, _HASH_MAP_DELETED);
+    }
+    map->length--;
+    return true;
+}
+
+bool hash_map_next(const hash_map_t* map, size_t* iterator, void** key, void** value) {
+    for (size_t i = *iterator; i < map->capacity; i++) {
+        if (map->ctrl[i] & 0x80) {
+            continue;
+        }
+        uint8_t* slot = _hash_map_slot(map, i);
+        if (key != NULL) {
+            *key = slot;
+        }
+        if (value != NULL) {
+            *value = slot + map->value_offset;
+        }
+        *iterator = i + 1;
+        return true;
+    }
+    *iterator = map->capacity;
+    return false;
+}
+
+// =============================================================================
+// STRING
+// =============================================================================
+
+#define _STR_BUILDER_MIN_CAPACITY 64
+
+str_t str_from_cstr(const char* cstr) {
+    return (str_t) { cstr, cstr == NULL ? 0 : strlen(cstr) };
+}
+
+str_t str_copy(arena_t* arena, str_t str) {
+    char* data = arena_push(arena, str.length + 1);
+    if (data == NULL) {
+        return (str_t) {0};
+    }
+    memcpy(data, str.data, str.length);
+    data[str.length] = '\0';
+    return (str_t) { data, str.length };
+}
+
+const char* str_to_cstr(arena_t* arena, str_t str) {
+    return str_copy(arena, str).data;
+}
+
+str_t str_format(arena_t* arena, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    str_t result = str_format_v(arena, format, args);
+    va_end(args);
+    return result;
+}
+
+str_t str_format_v(arena_t* arena, const char* format, va_list args) {
+    str_builder_t builder = str_builder_begin(arena, 0);
+    str_builder_append_format_v(&builder, format, args);
+    return str_builder_end(&builder);
+}
+
+str_t str_slice(str_t str, size_t start, size_t end) {
+    if (end > str.length) {
+        end = str.length;
+    }
+    if (start > end) {
+        start = end;
+    }
+    return (str_t) { str.data + start, end - start };
+}
+
+static bool _str_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+str_t str_trim(str_t str) {
+    while (str.length > 0 && _str_is_space(str.data[0])) {
+        str.data++;
+        str.length--;
+    }
+    while (str.length > 0 && _str_is_space(str.data[str.length - 1])) {
+        str.length--;
+    }
+    return str;
+}
+
+bool str_eq(str_t a, str_t b) {
+    return a.length == b.length && (a.length == 0 || memcmp(a.data, b.data, a.length) == 0);
+}
+
+int str_compare(str_t a, str_t b) {
+    size_t length = a.length < b.length ? a.length : b.length;
+    int result = length == 0 ? 0 : memcmp(a.data, b.data, length);
+    if (result != 0) {
+        return result;
+    }
+    return a.length < b.length ? -1 : a.length > b.length;
+}
+
+bool str_starts_with(str_t str, str_t prefix) {
+    return prefix.length <= str.length && str_eq(str_slice(str, 0, prefix.length), prefix);
+}
+
+bool str_ends_with(str_t str, str_t suffix) {
+    return suffix.length <= str.length && str_eq(str_slice(str, str.length - suffix.length, str.length), suffix);
+}
+
+uint64_t str_hash(str_t str) {
+    return hash_bytes(str.data, str.length);
+}
+
+size_t str_find_char(str_t str, char c) {
+    if (str.length == 0) {
+        return STR_NOT_FOUND;
+    }
+    const char* found = memchr(str.data, c, str.length);
+    return found == NULL ? STR_NOT_FOUND : (size_t) (found - str.data);
+}
+
+size_t str_find_last_char(str_t str, char c) {
+    for (size_t i = str.length; i > 0; i--) {
+        if (str.data[i - 1] == c) {
+            return i - 1;
+        }
+    }
+    return STR_NOT_FOUND;
+}
+
+size_t str_find(str_t str, str_t needle) {
+    if (needle.length == 0) {
+        return 0;
+    }
+    // Jump between occurrences of the first byte instead of comparing at every index.
+    size_t start = 0;
+    while (start + needle.length <= str.length) {
+        size_t index = str_find_char(str_slice(str, start, str.length - needle.length + 1), needle.data[0]);
+        if (index == STR_NOT_FOUND) {
+            break;
+        }
+        start += index;
+        if (memcmp(str.data + start + 1, needle.data + 1, needle.length - 1) == 0) {
+            return start;
+        }
+        start++;
+    }
+    return STR_NOT_FOUND;
+}
+
+bool str_split_next(str_t* remaining, char delimiter, str_t* token) {
+    if (remaining->data == NULL) {
+        return false;
+    }
+    size_t index = str_find_char(*remaining, delimiter);
+    if (index == STR_NOT_FOUND) {
+        *token = *remaining;
+        *remaining = (str_t) {0};
+        return true;
+    }
+    *token = str_slice(*remaining, 0, index);
+    *remaining = str_slice(*remaining, index + 1, remaining->length);
+    return true;
+}
+
+static void _str_builder_grow(str_builder_t* builder, size_t required) {
+    size_t capacity = builder->capacity * 2;
+    if (capacity < required) {
+        capacity = required;
+    }
+    if (capacity < _STR_BUILDER_MIN_CAPACITY) {
+        capacity = _STR_BUILDER_MIN_CAPACITY;
+    }
+    if (builder->data != NULL && arena_resize_in_place(builder->arena, builder->data, capacity)) {
+        builder->capacity = capacity;
+        return;
+    }
+    char* data = arena_push(builder->arena, capacity);
+    core_assert_msg(data != NULL, "Arena out of memory");
+    if (builder->length > 0) {
+        memcpy(data, builder->data, builder->length);
+    }
+    builder->data = data;
+    builder->capacity = capacity;
+}
+
+// Keeps room for the NUL terminator.
+static inline void _str_builder_reserve(str_builder_t* builder, size_t length) {
+    if (builder->length + length + 1 > builder->capacity) {
+        _str_builder_grow(builder, builder->length + length + 1);
+    }
+}
+
+str_builder_t str_builder_begin(arena_t* arena, size_t capacity) {
+    str_builder_t builder = { .arena = arena };
+    if (capacity > 0) {
+        _str_builder_grow(&builder, capacity + 1);
+    }
+    return builder;
+}
+
+void str_builder_append(str_builder_t* builder, str_t str) {
+    if (str.length == 0) {
+        return;
+    }
+    _str_builder_reserve(builder, str.length);
+    memcpy(&builder->data[builder->length], str.data, str.length);
+    builder->length += str.length;
+}
+
+void str_builder_append_char(str_builder_t* builder, char c) {
+    _str_builder_reserve(builder, 1);
+    builder->data[builder->length++] = c;
+}
+
+void str_builder_append_format(str_builder_t* builder, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    str_builder_append_format_v(builder, format, args);
+    va_end(args);
+}
+
+void str_builder_append_format_v(str_builder_t* builder, const char* format, va_list args) {
+    // Format straight into the spare capacity and only retry when it was too small.
+    if (builder->capacity < _STR_BUILDER_MIN_CAPACITY) {
+        _str_builder_grow(builder, _STR_BUILDER_MIN_CAPACITY);
+    }
+    va_list copy;
+    va_copy(copy, args);
+    size_t available = builder->capacity - builder->length;
+    int written = vsnprintf(&builder->data[builder->length], available, format, copy);
+    va_end(copy);
+    if (written < 0) {
+        return;
+    }
+    if ((size_t) written >= available) {
+        _str_builder_reserve(builder, (size_t) written);
+        vsnprintf(&builder->data[builder->length], (size_t) written + 1, format, args);
+    }
+    builder->length += (size_t) written;
+}
+
+str_t str_builder_end(str_builder_t* builder) {
+    _str_builder_reserve(builder, 0);
+    builder->data[builder->length] = '\0';
+    arena_resize_in_place(builder->arena, builder->data, builder->length + 1);
+    str_t result = { builder->data, builder->length };
+    *builder = (str_builder_t) {0};
+    return result;
+}
+
+// =============================================================================
+// JOB SYSTEM
+// =============================================================================
+
+typedef struct _job_parallel_for_t _job_parallel_for_t;
+struct _job_parallel_for_t {
+    job_range_func_t func;
+    void* data;
+    size_t grain;
+};
+
+// Either a plain job or a chunk of a parallel_for when 'range' is set.
+typedef struct _job_t _job_t;
+struct _job_t {
+    job_func_t func;
+    _job_parallel_for_t* range;
+    void* data;
+    job_counter_t* counter;
+    size_t begin;
+    size_t end;
+};
+
+// Thieves read a slot before their CAS on 'top' decides whether they own it,
+// so every field is atomic and read relaxed.
+typedef struct _job_slot_t _job_slot_t;
+struct _job_slot_t {
+    _Atomic(job_func_t) func;
+    _Atomic(_job_parallel_for_t*) range;
+    _Atomic(void*) data;
+    _Atomic(job_counter_t*) counter;
+    _Atomic size_t begin;
+    _Atomic size_t end;
+};
+
+// 'top' and 'bottom' sit on their own cache lines, as thieves hammer the
+// former while the owner works the latter.
+typedef struct _job_deque_t _job_deque_t;
+struct _job_deque_t {
+    _Atomic int64_t top;
+    uint8_t padding0[64 - sizeof(int64_t)];
+    _Atomic int64_t bottom;
+    uint8_t padding1[64 - sizeof(int64_t)];
+    _job_slot_t slots[JOB_DEQUE_CAPACITY];
+};
+
+typedef struct _job_system_t _job_system_t;
+struct _job_system_t {
+    allocator_t allocator;
+    uint32_t worker_count;
+    // Length of 'threads' and 'deques', which stays put when fewer workers start.
+    uint32_t capacity;
+    _os_thread_t* threads;
+    _job_deque_t* deques;
+    atomic_bool running;
+    // Shared queue for threads outside the pool, guarded by 'queue_lock'.
+    atomic_flag queue_lock;
+    _Atomic size_t queue_length;
+    size_t queue_head;
+    _job_t queue[JOB_QUEUE_CAPACITY];
+    _os_semaphore_t semaphore;
+    _Atomic int32_t sleeping;
+};
+
+static _job_system_t g_job_system = {0};
+static core_thread_local uint32_t t_job_worker = UINT32_MAX;
+static core_thread_local arena_t* t_job_arena = NULL;
+static core_thread_local uint32_t t_job_random = 0;
+
+static void _job_slot_store(_job_slot_t* slot, const _job_t* job) {
+    atomic_store_explicit(&slot->func, job->func, memory_order_relaxed);
+    atomic_store_explicit(&slot->range, job->range, memory_order_relaxed);
+    atomic_store_explicit(&slot->data, job->data, memory_order_relaxed);
+    atomic_store_explicit(&slot->counter, job->counter, memory_order_relaxed);
+    atomic_store_explicit(&slot->begin, job->begin, memory_order_relaxed);
+    atomic_store_explicit(&slot->end, job->end, memory_order_relaxed);
+}
+
+static void _job_slot_load(_job_slot_t* slot, _job_t* job) {
+    job->func = atomic_load_explicit(&slot->func, memory_order_relaxed);
+    job->range = atomic_load_explicit(&slot->range, memory_order_relaxed);
+    job->data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+    job->counter = atomic_load_explicit(&slot->counter, memory_order_relaxed);
+    job->begin = atomic_load_explicit(&slot->begin, memory_order_relaxed);
+    job->end = atomic_load_explicit(&slot->end, memory_order_relaxed);
+}
+
+// Owner only.
+static bool _job_deque_push(_job_deque_t* deque, const _job_t* job) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top >= JOB_DEQUE_CAPACITY) {
+        return false;
+    }
+    _job_slot_store(&deque->slots[bottom & (JOB_DEQUE_CAPACITY - 1)], job);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+    return true;
+}
+
+// Owner only, takes the newest job.
+static bool _job_deque_take(_job_deque_t* deque, _job_t* job) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return false;
+    }
+    _job_slot_load(&deque->slots[bottom & (JOB_DEQUE_CAPACITY - 1)], job);
+    if (top == bottom) {
+        // Last job, race the thieves for it.
+        bool won = atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+// Any thread, takes the oldest job.
+static bool _job_deque_steal(_job_deque_t* deque, _job_t* job) {
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) {
+        return false;
+    }
+    _job_slot_load(&deque->slots[top & (JOB_DEQUE_CAPACITY - 1)], job);
+    return atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+}
+
+static void _job_queue_lock(_job_system_t* system) {
+    while (atomic_flag_test_and_set_explicit(&system->queue_lock, memory_order_acquire)) {
+        _os_yield();
+    }
+}
+
+static void _job_queue_unlock(_job_system_t* system) {
+    atomic_flag_clear_explicit(&system->queue_lock, memory_order_release);
+}
+
+static bool _job_queue_push(_job_system_t* system, const _job_t* job) {
+    _job_queue_lock(system);
+    size_t length = atomic_load_explicit(&system->queue_length, memory_order_relaxed);
+    bool pushed = length < JOB_QUEUE_CAPACITY;
+    if (pushed) {
+        system->queue[(system->queue_head + length) & (JOB_QUEUE_CAPACITY - 1)] = *job;
+        atomic_store_explicit(&system->queue_length, length + 1, memory_order_relaxed);
+    }
+    _job_queue_unlock(system);
+    return pushed;
+}
+
+static bool _job_queue_pop(_job_system_t* system, _job_t* job) {
+    // Peek first so idle workers don't fight over the lock.
+    if (atomic_load_explicit(&system->queue_length, memory_order_relaxed) == 0) {
+        return false;
+    }
+    _job_queue_lock(system);
+    size_t length = atomic_load_explicit(&system->queue_length, memory_order_relaxed);
+    bool popped = length > 0;
+    if (popped) {
+        *job = system->queue[system->queue_head];
+        system->queue_head = (system->queue_head + 1) & (JOB_QUEUE_CAPACITY - 1);
+        atomic_store_explicit(&system->queue_length, length - 1, memory_order_relaxed);
+    }
+    _job_queue_unlock(system);
+    return popped;
+}
+
+static uint32_t _job_random(void) {
+    // xorshift32, seeded per thread.
+    uint32_t x = t_job_random;
+    if (x == 0) {
+        x = (uint32_t) _os_thread_id() * 2654435761u | 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    t_job_random = x;
+    return x;
+}
+
+static bool _job_next(_job_system_t* system, _job_t* job) {
+    uint32_t self = t_job_worker;
+    if (self != UINT32_MAX && _job_deque_take(&system->deques[self], job)) {
+        return true;
+    }
+    if (_job_queue_pop(system, job)) {
+        return true;
+    }
+    uint32_t count = system->worker_count;
+    uint32_t start = _job_random() % count;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t victim = (start + i) % count;
+        if (victim != self && _job_deque_steal(&system->deques[victim], job)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hands a parked worker a token. Workers that park after the push re-check
+// for work first, so a job is never left behind with everyone asleep. The
+// fence pairs with the one in the park path: either this load sees the
+// sleeper or the sleeper's re-check sees the job just published.
+static void _job_wake_one(_job_system_t* system) {
+    atomic_thread_fence(memory_order_seq_cst);
+    int32_t sleeping = atomic_load_explicit(&system->sleeping, memory_order_seq_cst);
+    while (sleeping > 0 && !atomic_compare_exchange_weak_explicit(&system->sleeping, &sleeping, sleeping - 1, memory_order_seq_cst, memory_order_relaxed));
+    if (sleeping > 0) {
+        _os_semaphore_post(&system->semaphore, 1);
+    }
+}
+
+static bool _job_push(_job_system_t* system, const _job_t* job) {
+    bool pushed = t_job_worker != UINT32_MAX ? _job_deque_push(&system->deques[t_job_worker], job) : _job_queue_push(system, job);
+    if (pushed) {
+        _job_wake_one(system);
+    }
+    return pushed;
+}
+
+static void _job_execute(_job_system_t* system, _job_t* job) {
+    arena_scope_t scope = scratch_begin(NULL, 0);
+    arena_t* outer_arena = t_job_arena;
+    t_job_arena = scope.arena;
+
+    if (job->range != NULL) {
+        _job_parallel_for_t* range = job->range;
+        // Keep splitting off the upper half for thieves until the chunk is small.
+        while (system != NULL && job->end - job->begin > range->grain) {
+            size_t middle = job->begin + (job->end - job->begin) / 2;
+            _job_t half = *job;
+            half.begin = middle;
+            atomic_fetch_add_explicit(&job->counter->pending, 1, memory_order_relaxed);
+            if (!_job_push(system, &half)) {
+                atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_relaxed);
+                break;
+            }
+            job->end = middle;
+        }
+        range->func(job->begin, job->end, range->data);
+    } else {
+        job->func(job->data);
+    }
+
+    t_job_arena = outer_arena;
+    scratch_end(&scope);
+    if (job->counter != NULL) {
+        atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_release);
+    }
+}
+
+static bool _job_has_work(_job_system_t* system) {
+    if (atomic_load_explicit(&system->queue_length, memory_order_relaxed) > 0) {
+        return true;
+    }
+    for (uint32_t i = 0; i < system->worker_count; i++) {
+        _job_deque_t* deque = &system->deques[i];
+        if (atomic_load_explicit(&deque->top, memory_order_relaxed) < atomic_load_explicit(&deque->bottom, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _job_worker_thread(void* data) {
+    _job_system_t* system = &g_job_system;
+    t_job_worker = (uint32_t) (uintptr_t) data;
+    uint32_t idle = 0;
+    _job_t job;
+    while (true) {
+        if (_job_next(system, &job)) {
+            _job_execute(system, &job);
+            idle = 0;
+            continue;
+        }
+        if (!atomic_load_explicit(&system->running, memory_order_acquire)) {
+            break;
+        }
+        if (idle < 64) {
+            idle++;
+            _os_yield();
+            continue;
+        }
+
+        atomic_fetch_add_explicit(&system->sleeping, 1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (_job_has_work(system) || !atomic_load_explicit(&system->running, memory_order_acquire)) {
+            // Take the token back unless a producer already claimed it.
+            int32_t sleeping = atomic_load_explicit(&system->sleeping, memory_order_seq_cst);
+            while (sleeping > 0 && !atomic_compare_exchange_weak_explicit(&system->sleeping, &sleeping, sleeping - 1, memory_order_seq_cst, memory_order_relaxed));
+            if (sleeping > 0) {
+                idle = 0;
+                continue;
+            }
+        }
+        _os_semaphore_wait(&system->semaphore);
+        idle = 0;
+    }
+    scratch_release();
+}
+
+bool job_system_start(allocator_t allocator, uint32_t worker_count) {
+    _job_system_t* system = &g_job_system;
+    core_assert_msg(system->threads == NULL, "Job system is already running");
+    if (worker_count == 0) {
+        worker_count = _os_core_count() > 1 ? _os_core_count() - 1 : 1;
+    }
+    system->allocator = allocator;
+    system->threads = core_alloc(allocator, sizeof(_os_thread_t) * worker_count);
+    system->deques = core_alloc(allocator, sizeof(_job_deque_t) * worker_count);
+    if (system->threads == NULL || system->deques == NULL) {
+        if (system->threads != NULL) {
+            core_free(allocator, system->threads, sizeof(_os_thread_t) * worker_count);
+        }
+        if (system->deques != NULL) {
+            core_free(allocator, system->deques, sizeof(_job_deque_t) * worker_count);
+        }
+        system->threads = NULL;
+        system->deques = NULL;
+        return false;
+    }
+    for (uint32_t i = 0; i < worker_count; i++) {
+        atomic_init(&system->deques[i].top, 0);
+        atomic_init(&system->deques[i].bottom, 0);
+    }
+    system->worker_count = worker_count;
+    system->capacity = worker_count;
+    system->queue_head = 0;
+    atomic_store(&system->queue_length, 0);
+    atomic_flag_clear(&system->queue_lock);
+    atomic_store(&system->sleeping, 0);
+    _os_semaphore_init(&system->semaphore);
+    atomic_store(&system->running, true);
+
+    for (uint32_t i = 0; i < worker_count; i++) {
+        if (!_os_thread_start(&system->threads[i], _job_worker_thread, (void*) (uintptr_t) i)) {
+            // Run with the workers that did start.
+            system->worker_count = i;
+            break;
+        }
+    }
+    if (system->worker_count == 0) {
+        job_system_stop();
+        return false;
+    }
+    return true;
+}
+
+void job_system_stop(void) {
+    _job_system_t* system = &g_job_system;
+    if (system->threads == NULL) {
+        return;
+    }
+    atomic_store_explicit(&system->running, false, memory_order_release);
+    _os_semaphore_post(&system->semaphore, system->worker_count);
+    for (uint32_t i = 0; i < system->worker_count; i++) {
+        _os_thread_join(&system->threads[i]);
+    }
+    // Jobs may still sit in the shared queue if every worker failed to start.
+    _job_t job;
+    while (_job_queue_pop(system, &job)) {
+        _job_execute(NULL, &job);
+    }
+    _os_semaphore_destroy(&system->semaphore);
+
+    core_free(system->allocator, system->threads, sizeof(_os_thread_t) * system->capacity);
+    core_free(system->allocator, system->deques, sizeof(_job_deque_t) * system->capacity);
+    system->threads = NULL;
+    system->deques = NULL;
+    system->worker_count = 0;
+    system->capacity = 0;
+}
+
+uint32_t job_system_worker_count(void) {
+    return g_job_system.worker_count;
+}
+
+uint32_t job_worker_index(void) {
+    return t_job_worker;
+}
+
+void job_run(job_func_t func, void* data, job_counter_t* counter) {
+    _job_system_t* system = &g_job_system;
+    _job_t job = {
+        .func = func,
+        .data = data,
+        .counter = counter,
+    };
+    if (counter != NULL) {
+        atomic_fetch_add_explicit(&counter->pending, 1, memory_order_relaxed);
+    }
+    if (system->threads == NULL || !_job_push(system, &job)) {
+        _job_execute(NULL, &job);
+    }
+}
+
+void job_wait(job_counter_t* counter) {
+    _job_system_t* system = &g_job_system;
+    _job_t job;
+    while (atomic_load_explicit(&counter->pending, memory_order_acquire) > 0) {
+        if (system->threads != NULL && _job_next(system, &job)) {
+            _job_execute(system, &job);
+        } else {
+            _os_yield();
+        }
+    }
 }
 
-size_t dyn_arr_length(const void* dyn_arr) {
-    if (dyn_arr == NULL) {
+void parallel_for(size_t count, size_t min_chunk, job_range_func_t func, void* data) {
+    if (count == 0) {
+        return;
+    }
+    _job_system_t* system = &g_job_system;
+    // Aim for several chunks per thread so uneven ranges still balance.
+    size_t grain = count / (8 * ((size_t) system->worker_count + 1));
+    if (grain < min_chunk) {
+        grain = min_chunk;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    _job_parallel_for_t range = {
+        .func = func,
+        .data = data,
+        .grain = grain,
+    };
+    job_counter_t counter = {0};
+    _job_t job = {
+        .range = &range,
+        .counter = &counter,
+        .begin = 0,
+        .end = count,
+    };
+    atomic_store_explicit(&counter.pending, 1, memory_order_relaxed);
+    _job_execute(system->threads != NULL ? system : NULL, &job);
+    job_wait(&counter);
+}
+
+arena_t* job_arena(void) {
+    return t_job_arena;
+}
+
+// =============================================================================
+// QUEUE
+// =============================================================================
+
+spsc_queue_t* spsc_queue_create(allocator_t allocator, size_t element_size, size_t capacity) {
+    core_assert_msg(element_size > 0, "Element size must be greater than 0");
+    core_assert_msg(_is_power_of_two(capacity) && capacity > 0, "Capacity must be a power of two");
+    spsc_queue_t* queue = core_alloc(allocator, sizeof(spsc_queue_t));
+    if (queue == NULL) {
+        return NULL;
+    }
+    uint8_t* buffer = core_alloc(allocator, element_size * capacity);
+    if (buffer == NULL) {
+        core_free(allocator, queue, sizeof(spsc_queue_t));
+        return NULL;
+    }
+    *queue = (spsc_queue_t) {
+        .allocator = allocator,
+        .buffer = buffer,
+        .element_size = element_size,
+        .capacity = capacity,
+    };
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->head, 0);
+    return queue;
+}
+
+void spsc_queue_destroy(spsc_queue_t** queue) {
+    spsc_queue_t* q = *queue;
+    core_free(q->allocator, q->buffer, q->element_size * q->capacity);
+    core_free(q->allocator, q, sizeof(spsc_queue_t));
+    *queue = NULL;
+}
+
+size_t spsc_queue_length(spsc_queue_t* queue) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    return tail - head;
+}
+
+// Copies 'count' elements between 'elements' and the ring starting at
+// 'position', wrapping around the end of the buffer.
+static void _spsc_queue_copy_in(spsc_queue_t* queue, size_t position, const uint8_t* elements, size_t count) {
+    size_t index = position & (queue->capacity - 1);
+    size_t first = queue->capacity - index < count ? queue->capacity - index : count;
+    memcpy(queue->buffer + index * queue->element_size, elements, first * queue->element_size);
+    memcpy(queue->buffer, elements + first * queue->element_size, (count - first) * queue->element_size);
+}
+
+static void _spsc_queue_copy_out(spsc_queue_t* queue, size_t position, uint8_t* elements, size_t count) {
+    size_t index = position & (queue->capacity - 1);
+    size_t first = queue->capacity - index < count ? queue->capacity - index : count;
+    memcpy(elements, queue->buffer + index * queue->element_size, first * queue->element_size);
+    memcpy(elements + first * queue->element_size, queue->buffer, (count - first) * queue->element_size);
+}
+
+size_t spsc_queue_push_n(spsc_queue_t* queue, const void* values, size_t count) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t free_count = queue->capacity - (tail - queue->cached_head);
+    if (free_count < count) {
+        queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+        free_count = queue->capacity - (tail - queue->cached_head);
+        if (free_count < count) {
+            count = free_count;
+        }
+    }
+    if (count == 0) {
         return 0;
     }
-    return _dyn_arr_to_header(dyn_arr)->length;
+    _spsc_queue_copy_in(queue, tail, values, count);
+    atomic_store_explicit(&queue->tail, tail + count, memory_order_release);
+    return count;
 }
 
-void dyn_arr_clear(void** dyn_arr) {
-    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
-    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
-    header->length = 0;
+size_t spsc_queue_pop_n(spsc_queue_t* queue, void* output, size_t count) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t available = queue->cached_tail - head;
+    if (available < count) {
+        queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        available = queue->cached_tail - head;
+        if (available < count) {
+            count = available;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    _spsc_queue_copy_out(queue, head, output, count);
+    atomic_store_explicit(&queue->head, head + count, memory_order_release);
+    return count;
 }
 
-static void _dyn_arr_ensure_capacity(void** dyn_arr, size_t length) {
-    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
-    if (header->capacity >= header->length + length) {
-        return;
+bool spsc_queue_push(spsc_queue_t* queue, const void* value) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - queue->cached_head == queue->capacity) {
+        queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+        if (tail - queue->cached_head == queue->capacity) {
+            return false;
+        }
     }
-    size_t prev_capacity = header->capacity;
-    size_t new_capacity = header->capacity;
-    while (new_capacity < header->length + length) {
-        new_capacity *= 2;
+    memcpy(queue->buffer + (tail & (queue->capacity - 1)) * queue->element_size, value, queue->element_size);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t* queue, void* output) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == queue->cached_tail) {
+        queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head == queue->cached_tail) {
+            return false;
+        }
     }
-    header = core_realloc(header->allocator,
-            header,
-            sizeof(_dyn_arr_header_t) + prev_capacity * header->element_size,
-            sizeof(_dyn_arr_header_t) + new_capacity * header->element_size);
-    *dyn_arr = _header_to_dyn_arr(header);
+    memcpy(output, queue->buffer + (head & (queue->capacity - 1)) * queue->element_size, queue->element_size);
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
 }
 
-void dyn_arr_insert_arr(void** dyn_arr, size_t index, const void* arr, size_t arr_length) {
-    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
-    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
-    core_assert_msg(index <= header->length, "Index out of bounds");
-    _dyn_arr_ensure_capacity(dyn_arr, arr_length);
-    header = _dyn_arr_to_header(*dyn_arr);
+static _Atomic size_t* _mpmc_queue_sequence(mpmc_queue_t* queue, size_t position) {
+    return (_Atomic size_t*) (queue->cells + (position & (queue->capacity - 1)) * queue->cell_size);
+}
 
-    void *end = (uint8_t*) (*dyn_arr) + (index+arr_length)*header->element_size;
-    void *dest = (uint8_t*) (*dyn_arr) + index*header->element_size;
+static void* _mpmc_queue_data(mpmc_queue_t* queue, size_t position) {
+    return queue->cells + (position & (queue->capacity - 1)) * queue->cell_size + queue->data_offset;
+}
 
-    memmove(end, dest, (header->length - index)*header->element_size);
-    if (arr == NULL) {
-        memset(dest, 0, arr_length*header->element_size);
-    } else {
-        memcpy(dest, arr, arr_length*header->element_size);
+mpmc_queue_t* mpmc_queue_create(allocator_t allocator, size_t element_size, size_t capacity) {
+    core_assert_msg(element_size > 0, "Element size must be greater than 0");
+    core_assert_msg(_is_power_of_two(capacity) && capacity > 0, "Capacity must be a power of two");
+    // The sequence number sits right in front of the element's data.
+    size_t align = _natural_alignment(element_size);
+    if (align < sizeof(size_t)) {
+        align = sizeof(size_t);
+    }
+    size_t data_offset = _align_up(sizeof(size_t), align);
+    size_t cell_size = _align_up(data_offset + element_size, align);
+    mpmc_queue_t* queue = core_alloc(allocator, sizeof(mpmc_queue_t));
+    if (queue == NULL) {
+        return NULL;
+    }
+    uint8_t* cells = core_alloc(allocator, cell_size * capacity);
+    if (cells == NULL) {
+        core_free(allocator, queue, sizeof(mpmc_queue_t));
+        return NULL;
+    }
+    *queue = (mpmc_queue_t) {
+        .allocator = allocator,
+        .cells = cells,
+        .element_size = element_size,
+        .capacity = capacity,
+        .cell_size = cell_size,
+        .data_offset = data_offset,
+    };
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(_mpmc_queue_sequence(queue, i), i);
     }
+    atomic_init(&queue->enqueue_position, 0);
+    atomic_init(&queue->dequeue_position, 0);
+    return queue;
+}
 
-    header->length += arr_length;
+void mpmc_queue_destroy(mpmc_queue_t** queue) {
+    mpmc_queue_t* q = *queue;
+    core_free(q->allocator, q->cells, q->cell_size * q->capacity);
+    core_free(q->allocator, q, sizeof(mpmc_queue_t));
+    *queue = NULL;
 }
 
-void dyn_arr_remove_arr(void** dyn_arr, size_t index, size_t count, void* output) {
-    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
-    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
-    core_assert_msg(index < header->length, "Index out of bounds");
-    core_assert_msg(index+count <= header->length, "Index out of bounds");
+size_t mpmc_queue_length(mpmc_queue_t* queue) {
+    size_t dequeue = atomic_load_explicit(&queue->dequeue_position, memory_order_relaxed);
+    size_t enqueue = atomic_load_explicit(&queue->enqueue_position, memory_order_relaxed);
+    return enqueue > dequeue ? enqueue - dequeue : 0;
+}
 
-    void *end = (uint8_t*) (*dyn_arr) + (index+count)*header->element_size;
-    void *dest = (uint8_t*) (*dyn_arr) + index*header->element_size;
+bool mpmc_queue_push(mpmc_queue_t* queue, const void* value) {
+    return mpmc_queue_push_n(queue, value, 1) == 1;
+}
 
-    if (output != NULL) {
-        memcpy(output, dest, count*header->element_size);
+bool mpmc_queue_pop(mpmc_queue_t* queue, void* output) {
+    return mpmc_queue_pop_n(queue, output, 1) == 1;
+}
+
+// Positions only move forward, so once the CAS from 'position' succeeds no
+// other producer can have claimed any cell that was found ready before it.
+size_t mpmc_queue_push_n(mpmc_queue_t* queue, const void* values, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    size_t position = atomic_load_explicit(&queue->enqueue_position, memory_order_relaxed);
+    size_t ready;
+    while (true) {
+        ready = 0;
+        while (ready < count && ready < queue->capacity) {
+            size_t sequence = atomic_load_explicit(_mpmc_queue_sequence(queue, position + ready), memory_order_acquire);
+            if (sequence != position + ready) {
+                break;
+            }
+            ready++;
+        }
+        if (ready == 0) {
+            size_t sequence = atomic_load_explicit(_mpmc_queue_sequence(queue, position), memory_order_acquire);
+            if ((intptr_t) sequence - (intptr_t) position < 0) {
+                // Full, the consumer of the previous lap hasn't finished.
+                return 0;
+            }
+            // Another producer got here first.
+            position = atomic_load_explicit(&queue->enqueue_position, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&queue->enqueue_position, &position, position + ready, memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
     }
-    memmove(dest, end, (header->length - index - count)*header->element_size);
 
-    header->length -= count;
+    const uint8_t* elements = values;
+    for (size_t i = 0; i < ready; i++) {
+        memcpy(_mpmc_queue_data(queue, position + i), elements + i * queue->element_size, queue->element_size);
+        atomic_store_explicit(_mpmc_queue_sequence(queue, position + i), position + i + 1, memory_order_release);
+    }
+    return ready;
 }
 
-void dyn_arr_insert(void** dyn_arr, size_t index, const void* value) {
-    dyn_arr_insert_arr(dyn_arr, index, value, 1);
+size_t mpmc_queue_pop_n(mpmc_queue_t* queue, void* output, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    size_t position = atomic_load_explicit(&queue->dequeue_position, memory_order_relaxed);
+    size_t ready;
+    while (true) {
+        ready = 0;
+        while (ready < count && ready < queue->capacity) {
+            size_t sequence = atomic_load_explicit(_mpmc_queue_sequence(queue, position + ready), memory_order_acquire);
+            if (sequence != position + ready + 1) {
+                break;
+            }
+            ready++;
+        }
+        if (ready == 0) {
+            size_t sequence = atomic_load_explicit(_mpmc_queue_sequence(queue, position), memory_order_acquire);
+            if ((intptr_t) sequence - (intptr_t) (position + 1) < 0) {
+                // Empty, or the producer of this cell is still writing.
+                return 0;
+            }
+            position = atomic_load_explicit(&queue->dequeue_position, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&queue->dequeue_position, &position, position + ready, memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    uint8_t* elements = output;
+    for (size_t i = 0; i < ready; i++) {
+        memcpy(elements + i * queue->element_size, _mpmc_queue_data(queue, position + i), queue->element_size);
+        atomic_store_explicit(_mpmc_queue_sequence(queue, position + i), position + i + queue->capacity, memory_order_release);
+    }
+    return ready;
 }
 
-void dyn_arr_remove(void** dyn_arr, size_t index, void* output) {
-    dyn_arr_remove_arr(dyn_arr, index, 1, output); \
+// =============================================================================
+// PROFILER
+// =============================================================================
+
+#if defined(CORE_PROFILE)
+
+#define _PROF_BINARY_MAGIC "HOARDPRF"
+#define _PROF_BINARY_MAGIC_SIZE 8
+
+enum {
+    _PROF_BINARY_NAME = 1,
+    _PROF_BINARY_EVENT = 2,
+    _PROF_BINARY_CLOCK = 3,
+};
+
+typedef struct _prof_event_t _prof_event_t;
+struct _prof_event_t {
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Only the owning thread writes, others read the relaxed snapshots.
+typedef struct _prof_zone_t _prof_zone_t;
+struct _prof_zone_t {
+    _Atomic(const char*) name;
+    _Atomic uint64_t count;
+    _Atomic uint64_t total;
+    _Atomic uint64_t min;
+    _Atomic uint64_t max;
+};
+
+typedef struct _prof_thread_t _prof_thread_t;
+struct _prof_thread_t {
+    _prof_thread_t* next;
+    uint64_t thread_id;
+    uint32_t depth;
+    const char* stack_names[PROF_MAX_DEPTH];
+    uint64_t stack_begins[PROF_MAX_DEPTH];
+    _prof_zone_t zones[PROF_MAX_ZONES];
+    // Single producer ring, drained by whoever flushes.
+    _prof_event_t* events;
+    _Atomic uint64_t dropped;
+    uint8_t padding0[64];
+    _Atomic size_t head;
+    uint8_t padding1[64 - sizeof(size_t)];
+    _Atomic size_t tail;
+    uint8_t padding2[64 - sizeof(size_t)];
+};
+
+typedef struct _prof_t _prof_t;
+struct _prof_t {
+    arena_t* arena;
+    size_t capacity;
+    atomic_flag lock;
+    _prof_thread_t* threads;
+    uint64_t start_ticks;
+    uint64_t start_ns;
+    FILE* trace;
+    prof_format_t format;
+    bool trace_empty;
+    // Ids of the names already written to a binary trace.
+    hash_map_t* names;
+};
+
+static _prof_t g_prof = {0};
+// Bumped by every prof_init so threads notice stale state, 0 while stopped.
+static _Atomic uint32_t g_prof_epoch = 0;
+static uint32_t g_prof_last_epoch = 0;
+static core_thread_local _prof_thread_t* t_prof_thread = NULL;
+static core_thread_local uint32_t t_prof_epoch = 0;
+
+static inline uint64_t _prof_ticks(void) {
+#if defined(_PROF_RDTSC)
+    return __rdtsc();
+#elif defined(__aarch64__) && defined(__GNUC__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return _os_monotonic_ns();
+#endif
 }
 
-void dyn_arr_insert_fast(void** dyn_arr, size_t index, const void* value) {
-    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
-    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
-    core_assert_msg(index <= header->length, "Index out of bounds");
-    _dyn_arr_ensure_capacity(dyn_arr, 1);
-    header = _dyn_arr_to_header(*dyn_arr);
+// Calibrated against the monotonic clock over the profiler's lifetime.
+static double _prof_ns_per_tick(void) {
+    uint64_t ticks = _prof_ticks() - g_prof.start_ticks;
+    uint64_t ns = _os_monotonic_ns() - g_prof.start_ns;
+    return ticks == 0 ? 1.0 : (double) ns / (double) ticks;
+}
 
-    void *end = (uint8_t*) (*dyn_arr) + header->length*header->element_size;
-    void *dest = (uint8_t*) (*dyn_arr) + index*header->element_size;
+static void _prof_lock(void) {
+    while (atomic_flag_test_and_set_explicit(&g_prof.lock, memory_order_acquire)) {
+        _os_yield();
+    }
+}
 
-    memcpy(end, dest, header->element_size);
-    if (value == NULL) {
-        memset(dest, 0, header->element_size);
-    } else {
-        memcpy(dest, value, header->element_size);
+static void _prof_unlock(void) {
+    atomic_flag_clear_explicit(&g_prof.lock, memory_order_release);
+}
+
+bool prof_init(size_t events_per_thread) {
+    core_assert_msg(atomic_load(&g_prof_epoch) == 0, "Profiler is already running");
+    if (events_per_thread == 0) {
+        events_per_thread = PROF_DEFAULT_EVENT_CAPACITY;
+    }
+    core_assert_msg(_is_power_of_two(events_per_thread), "Event capacity must be a power of two");
+    arena_t* arena = arena_create_reserve((size_t) 1024 * 1024 * 1024, 0);
+    if (arena == NULL) {
+        return false;
     }
+    g_prof = (_prof_t) {
+        .arena = arena,
+        .capacity = events_per_thread,
+        .start_ticks = _prof_ticks(),
+        .start_ns = _os_monotonic_ns(),
+    };
+    atomic_flag_clear(&g_prof.lock);
+    g_prof_last_epoch++;
+    if (g_prof_last_epoch == 0) {
+        g_prof_last_epoch++;
+    }
+    atomic_store_explicit(&g_prof_epoch, g_prof_last_epoch, memory_order_release);
+    return true;
+}
 
-    header->length++;
+void prof_shutdown(void) {
+    if (atomic_load(&g_prof_epoch) == 0) {
+        return;
+    }
+    prof_trace_close();
+    atomic_store_explicit(&g_prof_epoch, 0, memory_order_release);
+    arena_destroy(&g_prof.arena);
+    g_prof.threads = NULL;
 }
 
-void dyn_arr_remove_fast(void** dyn_arr, size_t index, void* output) {
-    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
-    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
-    core_assert_msg(index < header->length, "Index out of bounds");
+static _prof_thread_t* _prof_thread(void) {
+    uint32_t epoch = atomic_load_explicit(&g_prof_epoch, memory_order_acquire);
+    if (t_prof_epoch == epoch) {
+        return t_prof_thread;
+    }
+    t_prof_epoch = epoch;
+    t_prof_thread = NULL;
+    if (epoch == 0) {
+        return NULL;
+    }
 
-    void *end = (uint8_t*) (*dyn_arr) + (header->length-1)*header->element_size;
-    void *dest = (uint8_t*) (*dyn_arr) + index*header->element_size;
+    _prof_lock();
+    _prof_thread_t* thread = arena_push_aligned(g_prof.arena, sizeof(_prof_thread_t), 64);
+    _prof_event_t* events = arena_push(g_prof.arena, sizeof(_prof_event_t) * g_prof.capacity);
+    if (thread != NULL && events != NULL) {
+        memset(thread, 0, sizeof(_prof_thread_t));
+        thread->thread_id = _os_thread_id();
+        thread->events = events;
+        thread->next = g_prof.threads;
+        g_prof.threads = thread;
+        t_prof_thread = thread;
+    }
+    _prof_unlock();
+    return t_prof_thread;
+}
 
-    if (output != NULL) {
-        memcpy(output, dest, header->element_size);
+void _prof_zone_begin(const char* name) {
+    _prof_thread_t* thread = _prof_thread();
+    if (thread == NULL) {
+        return;
     }
-    memcpy(dest, end, header->element_size);
+    if (thread->depth < PROF_MAX_DEPTH) {
+        thread->stack_names[thread->depth] = name;
+        thread->stack_begins[thread->depth] = _prof_ticks();
+    }
+    thread->depth++;
+}
 
-    header->length--;
+static void _prof_zone_record(_prof_thread_t* thread, const char* name, uint64_t duration) {
+    uint32_t index = (uint32_t) (((uintptr_t) name >> 3) * 2654435761u) & (PROF_MAX_ZONES - 1);
+    for (uint32_t i = 0; i < PROF_MAX_ZONES; i++) {
+        _prof_zone_t* zone = &thread->zones[(index + i) & (PROF_MAX_ZONES - 1)];
+        const char* zone_name = atomic_load_explicit(&zone->name, memory_order_relaxed);
+        if (zone_name == NULL) {
+            atomic_store_explicit(&zone->min, UINT64_MAX, memory_order_relaxed);
+            atomic_store_explicit(&zone->name, name, memory_order_release);
+        } else if (zone_name != name) {
+            continue;
+        }
+        atomic_store_explicit(&zone->count, atomic_load_explicit(&zone->count, memory_order_relaxed) + 1, memory_order_relaxed);
+        atomic_store_explicit(&zone->total, atomic_load_explicit(&zone->total, memory_order_relaxed) + duration, memory_order_relaxed);
+        if (duration < atomic_load_explicit(&zone->min, memory_order_relaxed)) {
+            atomic_store_explicit(&zone->min, duration, memory_order_relaxed);
+        }
+        if (duration > atomic_load_explicit(&zone->max, memory_order_relaxed)) {
+            atomic_store_explicit(&zone->max, duration, memory_order_relaxed);
+        }
+        return;
+    }
 }
 
-void dyn_arr_push(void** dyn_arr, const void* value) {
-    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
-    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
-    _dyn_arr_ensure_capacity(dyn_arr, 1);
-    header = _dyn_arr_to_header(*dyn_arr);
+void _prof_zone_end(void) {
+    uint64_t end = _prof_ticks();
+    _prof_thread_t* thread = t_prof_thread;
+    if (thread == NULL || t_prof_epoch != atomic_load_explicit(&g_prof_epoch, memory_order_relaxed)) {
+        return;
+    }
+    core_assert_msg(thread->depth > 0, "Zone ended without being begun");
+    thread->depth--;
+    if (thread->depth >= PROF_MAX_DEPTH) {
+        return;
+    }
+    const char* name = thread->stack_names[thread->depth];
+    uint64_t begin = thread->stack_begins[thread->depth];
+    _prof_zone_record(thread, name, end - begin);
 
-    void *end = (uint8_t*) (*dyn_arr) + header->length*header->element_size;
-    memcpy(end, value, header->element_size);
-    header->length++;
+    size_t tail = atomic_load_explicit(&thread->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&thread->head, memory_order_acquire) == g_prof.capacity) {
+        atomic_fetch_add_explicit(&thread->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    thread->events[tail & (g_prof.capacity - 1)] = (_prof_event_t) {
+        .name = name,
+        .begin = begin,
+        .end = end,
+    };
+    atomic_store_explicit(&thread->tail, tail + 1, memory_order_release);
 }
 
-void dyn_arr_pop(void** dyn_arr, void* output) {
-    core_assert_msg(*dyn_arr != NULL, "Null pointer dereference");
-    _dyn_arr_header_t* header = _dyn_arr_to_header(*dyn_arr);
-    core_assert_msg(header->length > 0, "Index out of bounds");
+static void _prof_json_write_event(FILE* file, bool* empty, const char* name, size_t name_length, uint64_t thread_id, double timestamp_us, double duration_us) {
+    fputs(*empty ? "\n" : ",\n", file);
+    *empty = false;
+    fputs("{\"name\":\"", file);
+    for (size_t i = 0; i < name_length; i++) {
+        char c = name[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+            fputc(c, file);
+        } else if ((unsigned char) c < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned) c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f}", (unsigned long long) thread_id, timestamp_us, duration_us);
+}
 
-    if (output != NULL) {
-        void *end = (uint8_t*) (*dyn_arr) + (header->length - 1)*header->element_size;
-        memcpy(output, end, header->element_size);
+static void _prof_binary_write_record(FILE* file, uint8_t type, const void* payload, size_t size) {
+    fputc(type, file);
+    fwrite(payload, 1, size, file);
+}
+
+static uint32_t _prof_binary_name_id(const char* name) {
+    uint32_t* existing = hash_map_get(g_prof.names, &name);
+    if (existing != NULL) {
+        return *existing;
     }
-    header->length--;
+    uint32_t id = (uint32_t) hash_map_length(g_prof.names);
+    hash_map_insert(g_prof.names, &name, &id);
+
+    size_t length = strlen(name);
+    uint16_t name_length = length > UINT16_MAX ? UINT16_MAX : (uint16_t) length;
+    uint8_t header[6];
+    memcpy(header, &id, 4);
+    memcpy(header + 4, &name_length, 2);
+    _prof_binary_write_record(g_prof.trace, _PROF_BINARY_NAME, header, sizeof(header));
+    fwrite(name, 1, name_length, g_prof.trace);
+    return id;
 }
 
-void dyn_arr_push_arr(void** dyn_arr, const void* arr, size_t arr_length) {
-    dyn_arr_insert_arr(dyn_arr, dyn_arr_length(*dyn_arr), arr, arr_length);
+bool prof_trace_open(const char* path, prof_format_t format) {
+    core_assert_msg(atomic_load(&g_prof_epoch) != 0, "Profiler is not running");
+    core_assert_msg(g_prof.trace == NULL, "A trace is already open");
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, 64 * 1024);
+    if (format == PROF_FORMAT_BINARY) {
+        fwrite(_PROF_BINARY_MAGIC, 1, _PROF_BINARY_MAGIC_SIZE, file);
+        g_prof.names = hash_map_create(os_allocator(), sizeof(const char*), sizeof(uint32_t), NULL, NULL);
+    } else {
+        fputs("{\"traceEvents\":[", file);
+    }
+    _prof_lock();
+    g_prof.trace = file;
+    g_prof.format = format;
+    g_prof.trace_empty = true;
+    _prof_unlock();
+    return true;
 }
 
-void dyn_arr_pop_arr(void** dyn_arr, size_t count, void* output) {
-    core_assert(count <= dyn_arr_length(*dyn_arr));
-    size_t index = dyn_arr_length(*dyn_arr) - count;
-    dyn_arr_remove_arr(dyn_arr, index, count, output);
+void prof_trace_flush(void) {
+    if (atomic_load(&g_prof_epoch) == 0) {
+        return;
+    }
+    _prof_lock();
+    double ns_per_tick = _prof_ns_per_tick();
+    FILE* file = g_prof.trace;
+    for (_prof_thread_t* thread = g_prof.threads; thread != NULL; thread = thread->next) {
+        size_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&thread->tail, memory_order_acquire);
+        for (; file != NULL && head != tail; head++) {
+            _prof_event_t* event = &thread->events[head & (g_prof.capacity - 1)];
+            if (g_prof.format == PROF_FORMAT_BINARY) {
+                uint32_t id = _prof_binary_name_id(event->name);
+                uint64_t duration = event->end - event->begin;
+                uint8_t payload[28];
+                memcpy(payload, &id, 4);
+                memcpy(payload + 4, &thread->thread_id, 8);
+                memcpy(payload + 12, &event->begin, 8);
+                memcpy(payload + 20, &duration, 8);
+                _prof_binary_write_record(file, _PROF_BINARY_EVENT, payload, sizeof(payload));
+            } else {
+                double timestamp = (double) (event->begin - g_prof.start_ticks) * ns_per_tick / 1000.0;
+                double duration = (double) (event->end - event->begin) * ns_per_tick / 1000.0;
+                _prof_json_write_event(file, &g_prof.trace_empty, event->name, strlen(event->name), thread->thread_id, timestamp, duration);
+            }
+        }
+        atomic_store_explicit(&thread->head, tail, memory_order_release);
+    }
+    if (file != NULL && g_prof.format == PROF_FORMAT_BINARY) {
+        // The latest clock record tells the converter the tick rate.
+        uint64_t clock[4] = {g_prof.start_ticks, g_prof.start_ns, _prof_ticks(), _os_monotonic_ns()};
+        _prof_binary_write_record(file, _PROF_BINARY_CLOCK, clock, sizeof(clock));
+    }
+    if (file != NULL) {
+        fflush(file);
+    }
+    _prof_unlock();
+}
+
+void prof_trace_close(void) {
+    if (g_prof.trace == NULL) {
+        return;
+    }
+    prof_trace_flush();
+    _prof_lock();
+    if (g_prof.format == PROF_FORMAT_BINARY) {
+        hash_map_destroy(&g_prof.names);
+    } else {
+        fputs("\n]}\n", g_prof.trace);
+    }
+    fclose(g_prof.trace);
+    g_prof.trace = NULL;
+    _prof_unlock();
+}
+
+uint64_t prof_dropped_count(void) {
+    if (atomic_load(&g_prof_epoch) == 0) {
+        return 0;
+    }
+    uint64_t dropped = 0;
+    _prof_lock();
+    for (_prof_thread_t* thread = g_prof.threads; thread != NULL; thread = thread->next) {
+        dropped += atomic_load_explicit(&thread->dropped, memory_order_relaxed);
+    }
+    _prof_unlock();
+    return dropped;
+}
+
+bool prof_binary_to_chrome(allocator_t allocator, const char* binary_path, const char* json_path) {
+    FILE* file = fopen(binary_path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (file_size < _PROF_BINARY_MAGIC_SIZE) {
+        fclose(file);
+        return false;
+    }
+    uint8_t* data = core_alloc(allocator, (size_t) file_size);
+    if (data == NULL) {
+        fclose(file);
+        return false;
+    }
+    size_t size = fread(data, 1, (size_t) file_size, file);
+    fclose(file);
+    if (size != (size_t) file_size || memcmp(data, _PROF_BINARY_MAGIC, _PROF_BINARY_MAGIC_SIZE) != 0) {
+        core_free(allocator, data, (size_t) file_size);
+        return false;
+    }
+
+    // Names and the final clock come first, as events only reference them.
+    // Name ids are handed out in the order names are written, so each one is
+    // at most the number of names before it.
+    dyn_arr_t(str_t) names = dyn_arr_create(allocator, sizeof(str_t));
+    uint64_t clock[4] = {0};
+    bool malformed = false;
+    for (size_t offset = _PROF_BINARY_MAGIC_SIZE; offset < size && !malformed;) {
+        uint8_t type = data[offset++];
+        if (type == _PROF_BINARY_NAME && size - offset >= 6) {
+            uint32_t id;
+            uint16_t length;
+            memcpy(&id, data + offset, 4);
+            memcpy(&length, data + offset + 4, 2);
+            offset += 6;
+            if (size - offset < length) {
+                break;
+            }
+            str_t name = {(const char*) data + offset, length};
+            if (id < dyn_arr_length(names)) {
+                names[id] = name;
+            } else if (id == dyn_arr_length(names)) {
+                dyn_arr_push((void**) &names, &name);
+            } else {
+                malformed = true;
+            }
+            offset += length;
+        } else if (type == _PROF_BINARY_EVENT && size - offset >= 28) {
+            offset += 28;
+        } else if (type == _PROF_BINARY_CLOCK && size - offset >= sizeof(clock)) {
+            memcpy(clock, data + offset, sizeof(clock));
+            offset += sizeof(clock);
+        } else {
+            break;
+        }
+    }
+
+    FILE* output = malformed ? NULL : fopen(json_path, "wb");
+    bool valid = output != NULL;
+    if (valid) {
+        double ns_per_tick = clock[2] == clock[0] ? 1.0 : (double) (clock[3] - clock[1]) / (double) (clock[2] - clock[0]);
+        bool empty = true;
+        fputs("{\"traceEvents\":[", output);
+        for (size_t offset = _PROF_BINARY_MAGIC_SIZE; offset < size;) {
+            uint8_t type = data[offset++];
+            if (type == _PROF_BINARY_NAME && size - offset >= 6) {
+                uint16_t length;
+                memcpy(&length, data + offset + 4, 2);
+                offset += 6 + length;
+            } else if (type == _PROF_BINARY_EVENT && size - offset >= 28) {
+                uint32_t id;
+                uint64_t thread_id;
+                uint64_t begin;
+                uint64_t duration;
+                memcpy(&id, data + offset, 4);
+                memcpy(&thread_id, data + offset + 4, 8);
+                memcpy(&begin, data + offset + 12, 8);
+                memcpy(&duration, data + offset + 20, 8);
+                offset += 28;
+                str_t name = id < dyn_arr_length(names) ? names[id] : str_lit("?");
+                double timestamp = (double) (begin - clock[0]) * ns_per_tick / 1000.0;
+                _prof_json_write_event(output, &empty, name.data, name.length, thread_id, timestamp, (double) duration * ns_per_tick / 1000.0);
+            } else if (type == _PROF_BINARY_CLOCK && size - offset >= sizeof(clock)) {
+                offset += sizeof(clock);
+            } else {
+                break;
+            }
+        }
+        fputs("\n]}\n", output);
+        valid = fclose(output) == 0;
+    }
+
+    dyn_arr_destroy((void**) &names);
+    core_free(allocator, data, (size_t) file_size);
+    return valid;
+}
+
+size_t prof_stats(prof_zone_stats_t* stats, size_t capacity) {
+    if (atomic_load(&g_prof_epoch) == 0) {
+        return 0;
+    }
+    size_t count = 0;
+    _prof_lock();
+    double ns_per_tick = _prof_ns_per_tick();
+    for (_prof_thread_t* thread = g_prof.threads; thread != NULL; thread = thread->next) {
+        for (uint32_t i = 0; i < PROF_MAX_ZONES; i++) {
+            _prof_zone_t* zone = &thread->zones[i];
+            const char* name = atomic_load_explicit(&zone->name, memory_order_acquire);
+            uint64_t zone_count = atomic_load_explicit(&zone->count, memory_order_relaxed);
+            if (name == NULL || zone_count == 0) {
+                continue;
+            }
+            // The same literal may have different addresses in different translation units.
+            prof_zone_stats_t* entry = NULL;
+            for (size_t j = 0; j < count; j++) {
+                if (stats[j].name == name || strcmp(stats[j].name, name) == 0) {
+                    entry = &stats[j];
+                    break;
+                }
+            }
+            if (entry == NULL) {
+                if (count == capacity) {
+                    continue;
+                }
+                entry = &stats[count++];
+                *entry = (prof_zone_stats_t) {
+                    .name = name,
+                    .min_ns = UINT64_MAX,
+                };
+            }
+            uint64_t min = (uint64_t) ((double) atomic_load_explicit(&zone->min, memory_order_relaxed) * ns_per_tick);
+            uint64_t max = (uint64_t) ((double) atomic_load_explicit(&zone->max, memory_order_relaxed) * ns_per_tick);
+            entry->count += zone_count;
+            entry->total_ns += (uint64_t) ((double) atomic_load_explicit(&zone->total, memory_order_relaxed) * ns_per_tick);
+            entry->min_ns = min < entry->min_ns ? min : entry->min_ns;
+            entry->max_ns = max > entry->max_ns ? max : entry->max_ns;
+        }
+    }
+    _prof_unlock();
+    return count;
 }
 
+void prof_log_stats(log_level_t level) {
+    if (!_log_enabled(level)) {
+        return;
+    }
+    arena_scope_t scratch = scratch_begin(NULL, 0);
+    prof_zone_stats_t* stats = arena_push(scratch.arena, sizeof(prof_zone_stats_t) * PROF_MAX_ZONES);
+    size_t count = prof_stats(stats, PROF_MAX_ZONES);
+    for (size_t i = 1; i < count; i++) {
+        for (size_t j = i; j > 0 && stats[j].total_ns > stats[j - 1].total_ns; j--) {
+            prof_zone_stats_t swap = stats[j];
+            stats[j] = stats[j - 1];
+            stats[j - 1] = swap;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        prof_zone_stats_t* zone = &stats[i];
+        _log_log(level, __FILE__, __LINE__, "%s: count %llu, total %.3f ms, mean %.3f us, min %.3f us, max %.3f us",
+            zone->name, (unsigned long long) zone->count, (double) zone->total_ns / 1e6,
+            (double) zone->total_ns / (double) zone->count / 1e3, (double) zone->min_ns / 1e3, (double) zone->max_ns / 1e3);
+    }
+    scratch_end(&scratch);
+}
+
+#endif
+
 #endif // CORE_IMPLEMENTATION
 #endif // CORE_H
@@ -0,0 +1,352 @@
+// Smoke tests for the lock-free paths: every value handed to a queue comes
+// out exactly once, concurrent appends are only visible once written, every
+// job runs exactly once and parked workers wake up for new jobs. Run them under the thread sanitizer as well:
+//
+//     make -C test run
+//     make -C test clean run CFLAGS="-O1 -g -fsanitize=thread"
+//     ./test/stress mpmc                  # only tests whose name matches
+//
+// Exits non-zero on the first failed check.
+
+#define _DEFAULT_SOURCE
+#define CORE_IMPLEMENTATION
+#include "../core.h"
+
+#include <stdlib.h>
+
+#define check(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+typedef struct stress_t stress_t;
+struct stress_t {
+    const char* name;
+    void (*run)(void);
+};
+
+static void* _malloc_alloc(size_t size, void* context) {
+    unused(context);
+    return malloc(size);
+}
+
+static void* _malloc_realloc(void* ptr, size_t old_size, size_t new_size, void* context) {
+    unused(old_size);
+    unused(context);
+    return realloc(ptr, new_size);
+}
+
+static void _malloc_free(void* ptr, size_t size, void* context) {
+    unused(size);
+    unused(context);
+    free(ptr);
+}
+
+static const allocator_t g_malloc_allocator = {
+    .alloc = _malloc_alloc,
+    .realloc = _malloc_realloc,
+    .free = _malloc_free,
+    .context = NULL,
+};
+
+// How often each value came out, for tests with up to STRESS_MAX_VALUES values.
+#define STRESS_MAX_VALUES 200000
+static _Atomic uint32_t g_seen[STRESS_MAX_VALUES];
+
+// =============================================================================
+// QUEUES
+// =============================================================================
+
+#define QUEUE_THREADS 4
+#define QUEUE_VALUES 50000
+#define QUEUE_BATCH 7
+
+static mpmc_queue_t* g_mpmc_queue = NULL;
+static _Atomic uint32_t g_consumed = 0;
+
+// Values are tagged with their producer so each one is unique. Odd
+// producers push in batches.
+static void _mpmc_producer(void* data) {
+    uint32_t base = (uint32_t) (uintptr_t) data * QUEUE_VALUES;
+    uint32_t batch[QUEUE_BATCH];
+    for (uint32_t i = 0; i < QUEUE_VALUES;) {
+        size_t pushed;
+        if ((base / QUEUE_VALUES) % 2 == 1) {
+            uint32_t count = 0;
+            for (; count < QUEUE_BATCH && i + count < QUEUE_VALUES; count++) {
+                batch[count] = base + i + count;
+            }
+            pushed = mpmc_queue_push_n_t(g_mpmc_queue, uint32_t, batch, count);
+        } else {
+            pushed = mpmc_queue_push_t(g_mpmc_queue, uint32_t, base + i) ? 1 : 0;
+        }
+        i += (uint32_t) pushed;
+        if (pushed == 0) {
+            _os_yield();
+        }
+    }
+}
+
+static void _mpmc_consumer(void* data) {
+    bool batched = (uintptr_t) data % 2 == 1;
+    uint32_t values[QUEUE_BATCH];
+    while (atomic_load_explicit(&g_consumed, memory_order_relaxed) < QUEUE_THREADS * QUEUE_VALUES) {
+        size_t popped = batched ?
+            mpmc_queue_pop_n_t(g_mpmc_queue, uint32_t, values, QUEUE_BATCH) :
+            (mpmc_queue_pop_t(g_mpmc_queue, uint32_t, values) ? 1 : 0);
+        for (size_t i = 0; i < popped; i++) {
+            atomic_fetch_add_explicit(&g_seen[values[i]], 1, memory_order_relaxed);
+        }
+        atomic_fetch_add_explicit(&g_consumed, (uint32_t) popped, memory_order_relaxed);
+        if (popped == 0) {
+            _os_yield();
+        }
+    }
+}
+
+static void stress_mpmc_queue(void) {
+    check(QUEUE_THREADS * QUEUE_VALUES <= STRESS_MAX_VALUES);
+    g_mpmc_queue = mpmc_queue_create_t(g_malloc_allocator, uint32_t, 256);
+    check(g_mpmc_queue != NULL);
+    atomic_store(&g_consumed, 0);
+    for (size_t i = 0; i < QUEUE_THREADS * QUEUE_VALUES; i++) {
+        atomic_store(&g_seen[i], 0);
+    }
+
+    _os_thread_t threads[2 * QUEUE_THREADS];
+    for (uintptr_t i = 0; i < QUEUE_THREADS; i++) {
+        check(_os_thread_start(&threads[i], _mpmc_producer, (void*) i));
+        check(_os_thread_start(&threads[QUEUE_THREADS + i], _mpmc_consumer, (void*) i));
+    }
+    for (size_t i = 0; i < 2 * QUEUE_THREADS; i++) {
+        _os_thread_join(&threads[i]);
+    }
+
+    for (size_t i = 0; i < QUEUE_THREADS * QUEUE_VALUES; i++) {
+        check(atomic_load(&g_seen[i]) == 1);
+    }
+    check(mpmc_queue_length(g_mpmc_queue) == 0);
+    mpmc_queue_destroy(&g_mpmc_queue);
+}
+
+static spsc_queue_t* g_spsc_queue = NULL;
+
+static void _spsc_producer(void* data) {
+    unused(data);
+    uint32_t batch[QUEUE_BATCH];
+    for (uint32_t i = 0; i < QUEUE_VALUES;) {
+        size_t pushed;
+        if (i % 3 == 0) {
+            uint32_t count = 0;
+            for (; count < QUEUE_BATCH && i + count < QUEUE_VALUES; count++) {
+                batch[count] = i + count;
+            }
+            pushed = spsc_queue_push_n_t(g_spsc_queue, uint32_t, batch, count);
+        } else {
+            pushed = spsc_queue_push_t(g_spsc_queue, uint32_t, i) ? 1 : 0;
+        }
+        i += (uint32_t) pushed;
+        if (pushed == 0) {
+            _os_yield();
+        }
+    }
+}
+
+// The single consumer must see every value in order.
+static void stress_spsc_queue(void) {
+    g_spsc_queue = spsc_queue_create_t(g_malloc_allocator, uint32_t, 64);
+    check(g_spsc_queue != NULL);
+    _os_thread_t producer;
+    check(_os_thread_start(&producer, _spsc_producer, NULL));
+
+    uint32_t values[QUEUE_BATCH];
+    for (uint32_t expected = 0; expected < QUEUE_VALUES;) {
+        size_t popped = expected % 2 == 0 ?
+            spsc_queue_pop_n_t(g_spsc_queue, uint32_t, values, QUEUE_BATCH) :
+            (spsc_queue_pop_t(g_spsc_queue, uint32_t, values) ? 1 : 0);
+        for (size_t i = 0; i < popped; i++) {
+            check(values[i] == expected++);
+        }
+        if (popped == 0) {
+            _os_yield();
+        }
+    }
+    _os_thread_join(&producer);
+    check(spsc_queue_length(g_spsc_queue) == 0);
+    spsc_queue_destroy(&g_spsc_queue);
+}
+
+// =============================================================================
+// SEGMENTED ARRAY
+// =============================================================================
+
+#define SEG_ARR_THREADS 4
+#define SEG_ARR_VALUES 50000
+
+static seg_arr_t* g_seg_arr = NULL;
+static _Atomic uint32_t g_seg_arr_appenders = 0;
+
+// Values are never zero, so a reader seeing zero below the published length
+// caught an element before its copy landed.
+static void _seg_arr_appender(void* data) {
+    uint32_t base = (uint32_t) (uintptr_t) data * SEG_ARR_VALUES + 1;
+    for (uint32_t i = 0; i < SEG_ARR_VALUES; i++) {
+        check(seg_arr_push_concurrent_t(g_seg_arr, uint32_t, base + i) != NULL);
+    }
+    atomic_fetch_sub_explicit(&g_seg_arr_appenders, 1, memory_order_release);
+}
+
+static void stress_seg_arr_concurrent(void) {
+    check(SEG_ARR_THREADS * SEG_ARR_VALUES <= STRESS_MAX_VALUES);
+    g_seg_arr = seg_arr_create(g_malloc_allocator, sizeof(uint32_t), 4);
+    check(g_seg_arr != NULL);
+    atomic_store(&g_seg_arr_appenders, SEG_ARR_THREADS);
+    _os_thread_t threads[SEG_ARR_THREADS];
+    for (uintptr_t i = 0; i < SEG_ARR_THREADS; i++) {
+        check(_os_thread_start(&threads[i], _seg_arr_appender, (void*) i));
+    }
+
+    size_t checked = 0;
+    while (atomic_load_explicit(&g_seg_arr_appenders, memory_order_acquire) > 0) {
+        size_t length = seg_arr_length(g_seg_arr);
+        for (; checked < length; checked++) {
+            check(seg_arr_get_t(g_seg_arr, uint32_t, checked) != 0);
+        }
+        _os_yield();
+    }
+    for (size_t i = 0; i < SEG_ARR_THREADS; i++) {
+        _os_thread_join(&threads[i]);
+    }
+
+    check(seg_arr_length(g_seg_arr) == SEG_ARR_THREADS * SEG_ARR_VALUES);
+    for (size_t i = 0; i < SEG_ARR_THREADS * SEG_ARR_VALUES; i++) {
+        atomic_store(&g_seen[i], 0);
+    }
+    for (size_t i = 0; i < SEG_ARR_THREADS * SEG_ARR_VALUES; i++) {
+        uint32_t value = seg_arr_get_t(g_seg_arr, uint32_t, i);
+        check(value != 0 && value <= SEG_ARR_THREADS * SEG_ARR_VALUES);
+        atomic_fetch_add_explicit(&g_seen[value - 1], 1, memory_order_relaxed);
+    }
+    for (size_t i = 0; i < SEG_ARR_THREADS * SEG_ARR_VALUES; i++) {
+        check(atomic_load(&g_seen[i]) == 1);
+    }
+    seg_arr_destroy(&g_seg_arr);
+}
+
+// =============================================================================
+// JOB SYSTEM
+// =============================================================================
+
+#define JOB_WORKERS 3
+#define JOB_RANGE 100000
+#define JOB_ROUNDS 20
+
+static _Atomic uint32_t g_hits[JOB_RANGE];
+
+static void _job_hit_range(size_t begin, size_t end, void* data) {
+    unused(data);
+    for (size_t i = begin; i < end; i++) {
+        atomic_fetch_add_explicit(&g_hits[i], 1, memory_order_relaxed);
+    }
+}
+
+// Every index is visited exactly once per round, however the range is split.
+static void stress_parallel_for(void) {
+    check(job_system_start(g_malloc_allocator, JOB_WORKERS));
+    for (size_t i = 0; i < JOB_RANGE; i++) {
+        atomic_store(&g_hits[i], 0);
+    }
+    for (uint32_t round = 1; round <= JOB_ROUNDS; round++) {
+        parallel_for(JOB_RANGE, round, _job_hit_range, NULL);
+        for (size_t i = 0; i < JOB_RANGE; i++) {
+            check(atomic_load_explicit(&g_hits[i], memory_order_relaxed) == round);
+        }
+    }
+    job_system_stop();
+}
+
+typedef struct _job_tree_t _job_tree_t;
+struct _job_tree_t {
+    uint32_t depth;
+    uint64_t leaves;
+};
+
+// Each node forks two children and waits on them from inside a job.
+static void _job_tree(void* data) {
+    _job_tree_t* node = data;
+    if (node->depth == 0) {
+        node->leaves = 1;
+        return;
+    }
+    _job_tree_t children[2] = {{node->depth - 1, 0}, {node->depth - 1, 0}};
+    job_counter_t counter = {0};
+    job_run(_job_tree, &children[0], &counter);
+    job_run(_job_tree, &children[1], &counter);
+    job_wait(&counter);
+    node->leaves = children[0].leaves + children[1].leaves;
+}
+
+static void stress_job_fork_join(void) {
+    check(job_system_start(g_malloc_allocator, JOB_WORKERS));
+    for (uint32_t round = 0; round < JOB_ROUNDS; round++) {
+        _job_tree_t root = {12, 0};
+        job_counter_t counter = {0};
+        job_run(_job_tree, &root, &counter);
+        job_wait(&counter);
+        check(root.leaves == 1u << 12);
+    }
+    job_system_stop();
+}
+
+static void _job_set_flag(void* data) {
+    atomic_store_explicit((atomic_bool*) data, true, memory_order_release);
+}
+
+// Lets every worker park, then submits one job without helping to run it.
+// A lost wakeup leaves the job queued with everyone asleep.
+static void stress_job_wakeup(void) {
+    check(job_system_start(g_malloc_allocator, JOB_WORKERS));
+    for (uint32_t round = 0; round < 200; round++) {
+        _os_sleep_ms(2);
+        atomic_bool done = false;
+        job_run(_job_set_flag, &done, NULL);
+        uint64_t deadline = _os_monotonic_ns() + 2000000000ull;
+        while (!atomic_load_explicit(&done, memory_order_acquire)) {
+            check(_os_monotonic_ns() < deadline);
+            _os_yield();
+        }
+    }
+    job_system_stop();
+}
+
+// =============================================================================
+// MAIN
+// =============================================================================
+
+static const stress_t g_stresses[] = {
+    { "mpmc_queue", stress_mpmc_queue },
+    { "spsc_queue", stress_spsc_queue },
+    { "seg_arr_concurrent", stress_seg_arr_concurrent },
+    { "parallel_for", stress_parallel_for },
+    { "job_fork_join", stress_job_fork_join },
+    { "job_wakeup", stress_job_wakeup },
+};
+
+#define STRESS_COUNT (sizeof(g_stresses) / sizeof(g_stresses[0]))
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : NULL;
+    for (size_t i = 0; i < STRESS_COUNT; i++) {
+        if (filter != NULL && strstr(g_stresses[i].name, filter) == NULL) {
+            continue;
+        }
+        uint64_t start = _os_monotonic_ns();
+        g_stresses[i].run();
+        printf("%-20s ok %8.1f ms\n", g_stresses[i].name, (double) (_os_monotonic_ns() - start) / 1e6);
+        fflush(stdout);
+    }
+    return 0;
+}